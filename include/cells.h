@@ -20,14 +20,37 @@
 #define EAST 4
 #define WEST 3
 
+/* north <-> south, west <-> east */
+#define OPPOSITE(c) ((((c) - 1) ^ 1) + 1)
+
+/*  Build with CELLS_COMPACT defined to pack cells and tiles as tight as the
+*   rules allow: ages never pass 2048, oscillators never pass 800, and energy
+*   saturates at 16 bits instead of 32. Ids shrink to 32 bits, nothing looks
+*   cells up by id (the pool handle does that) so they only need to tell
+*   things apart.
+*/
+#ifdef CELLS_COMPACT
+typedef uint32_t cell_id_t;
+typedef uint16_t energy_t;
+typedef uint16_t age_t;
+typedef uint16_t oscil_t;
+#define ENERGY_MAX UINT16_MAX
+#else
+typedef uint64_t cell_id_t;
+typedef uint32_t energy_t;
+typedef unsigned int age_t;
+typedef unsigned int oscil_t;
+#define ENERGY_MAX UINT32_MAX
+#endif
+
 struct cell {
-	uint64_t id;
+	cell_id_t id;
 
-	uint32_t energy;
-	unsigned int age;
+	energy_t energy;
+	age_t age;
 
-	unsigned int oscil_dur;
-	unsigned int oscil_ctr;
+	oscil_t oscil_dur;
+	oscil_t oscil_ctr;
 
 	int compass;
 
@@ -37,12 +60,12 @@ struct cell {
 };
 
 struct dead_thing {
-	uint64_t id;
-	uint32_t energy;
+	cell_id_t id;
+	energy_t energy;
 };
 
 void gen_random_cell(struct cell *c, generator_handle g);
 
-uint32_t calc_death_energy(struct cell *c);
+uint32_t calc_death_energy(uint32_t energy);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,34 @@
+/*  SPDX-License-Identifier: GPL-3.0-only
+*   Cellular life simulation following strict rules
+*   Copyright (C) 2023 Teresa Maria Rivera
+*/
+
+#ifndef CELLS_CPU_H__
+#define CELLS_CPU_H__
+
+/*  The build only assumes plain x86-64. The kernels that gain anything
+*   from more get built for each of these too, and the one for the cpu
+*   it's running on gets picked at runtime, see cpu.c. Every level has
+*   everything the ones under it have.
+*/
+#define CPU_SCALAR 0 /* SSE2, which every x86-64 has */
+#define CPU_SSE42  1 /* SSE4.2, POPCNT and AES-NI */
+#define CPU_AVX2   2 /* AVX2, BMI1/2 and LZCNT */
+#define CPU_AVX512 3 /* AVX-512 F, BW, VL and DQ */
+
+/*  for __attribute__ on the kernels of each level. No FMA anywhere, a fused
+*   multiply add rounds differently and the floats have to come out the
+*   same whichever kernel ran.
+*/
+#define CPU_TARGET_SSE42  __target__("sse4.2,popcnt,aes")
+#define CPU_TARGET_AVX2   __target__("sse4.2,popcnt,aes,avx2,bmi,bmi2,lzcnt")
+#define CPU_TARGET_AVX512 __target__("sse4.2,popcnt,aes,avx2,bmi,bmi2," \
+	"lzcnt,avx512f,avx512bw,avx512vl,avx512dq")
+
+/*  the level this cpu is at, worked out the first time. CELLS_CPU in the
+*   environment can hold it down to scalar, sse4.2 or avx2, to try the
+*   other kernels out on one machine.
+*/
+int cpu_level(void);
+
+#endif
@@ -7,6 +7,10 @@
 #define CELLS_GENETICS_H__
 
 #include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <math.h>
+#include "include/math.h"
 
 /* where GENE is the gene, 
 *  GENE.output is the integer at GENE[7:0], 
@@ -50,12 +54,219 @@
 
 typedef uint32_t gene_t;
 
+/*  A gene taken apart ahead of time, so stepping a cell doesn't have to
+*   sanitize it, pick the bits apart or touch sinf. Redone whenever the
+*   gene changes, which is only ever at birth or mutation.
+*/
+struct gene_prog {
+	uint8_t input;
+	uint8_t output;
+	float strength; /* 4*sinf(0.25*strength), what the input is scaled by */
+	fixed_t fixed;  /* the same in fixed point */
+};
+
+/*  What a gene ends up doing once its input is scaled and clamped, output()
+*   only ever compares that against a few thresholds. Nearly every input is
+*   -1, 0 or 1, so for those the action can be worked out ahead of time for
+*   each of the three values, see compile_genes.
+*/
+#define ACT_NONE          0
+#define ACT_MOVE_NORTH    1 /* the moves match the compass points */
+#define ACT_MOVE_SOUTH    2
+#define ACT_MOVE_WEST     3
+#define ACT_MOVE_EAST     4
+#define ACT_MOVE_FORWARD  5
+#define ACT_MOVE_BACKWARD 6
+#define ACT_SUICIDE       7
+#define ACT_KILL_FORWARD  8
+#define ACT_KILL_BACKWARD 9
+#define ACT_OSC_POS       10
+#define ACT_OSC_NEG       11
+#define ACT_SENSE         12 /* the input isn't discrete, decide every time */
+
+struct gene_action {
+	uint8_t op;
+	uint16_t osc; /* what the oscillator gets set to */
+};
+
+/*  A gene run start to finish for one (input, output) pair, there's one of
+*   these for each of the 13x7 in cells.c, see GENES_TABLE
+*/
+struct world;
+typedef struct gene_action (*gene_handler)(struct world *w, uint32_t c,
+	uint16_t sw, uint32_t s, fixed_t strength);
+
+/* decide_action with in as Q16.16 */
+static inline struct gene_action decide_action_fixed(uint8_t output,
+	fixed_t in)
+{
+	struct gene_action a = { ACT_NONE, 0 };
+	uint32_t mag = in < 0 ? -(int64_t)in : in;
+	unsigned int tmp;
+
+	switch(output) {
+		case GENE_MOVE_X:
+		if(in > FIXED_ONE)
+			a.op = ACT_MOVE_EAST;
+		else if(in < -FIXED_ONE)
+			a.op = ACT_MOVE_WEST;
+		break;
+
+		case GENE_MOVE_Y:
+		if(in > FIXED_ONE)
+			a.op = ACT_MOVE_NORTH;
+		else if(in < -FIXED_ONE)
+			a.op = ACT_MOVE_SOUTH;
+		break;
+
+		case GENE_MOVE_FORWARD:
+		if(in > FIXED_ONE)
+			a.op = ACT_MOVE_FORWARD;
+		else if(in < -FIXED_ONE)
+			a.op = ACT_MOVE_BACKWARD;
+		break;
+
+		case GENE_COMMIT_SUICIDE:
+		if(mag > 7 * FIXED_ONE / 2)
+			a.op = ACT_SUICIDE;
+		break;
+
+		case GENE_SET_OSCILATOR:
+		tmp = (mag * 100) >> FIXED_SHIFT;
+
+		/* some weird sanitization, 6553 is the last one under 0.1 */
+		if(mag <= 6553 && tmp != 1)
+			break;
+
+		a.op = in < 0 ? ACT_OSC_NEG : ACT_OSC_POS;
+		a.osc = tmp;
+		break;
+
+		case GENE_KILL_FORWARD:
+		if(in < -2 * FIXED_ONE)
+			a.op = ACT_KILL_BACKWARD;
+		else if(in > 2 * FIXED_ONE)
+			a.op = ACT_KILL_FORWARD;
+		break;
+	}
+
+	return a;
+}
+
+/*  an input times a gene's strength, clamped to [-4, 4] like the floats,
+*   a nan strength always comes out as -4 there, so it does here too
+*/
+static inline fixed_t scale_fixed(int64_t in, fixed_t strength)
+{
+	int64_t v;
+
+	if(strength == FIXED_NAN)
+		return -4 * FIXED_ONE;
+
+	v = (in * strength) >> FIXED_SHIFT;
+	return v > 4 * FIXED_ONE ? 4 * FIXED_ONE :
+		v < -4 * FIXED_ONE ? -4 * FIXED_ONE : v;
+}
+
+/*  decide_action as thresholds, so all four genes can be decided at once:
+*   a lane over hi does on_hi, under lo does on_lo. Lanes that set the
+*   oscillator are in osc instead, their sanitization doesn't fit that.
+*/
+struct gene_lanes {
+	_Alignas(16) float strength[4];
+	_Alignas(16) float hi[4];
+	_Alignas(16) float lo[4];
+	uint8_t on_hi[4];
+	uint8_t on_lo[4];
+	uint8_t osc;
+};
+
+/* input is one of these for a discrete input, the value plus one */
+#define SENSE_NEG  0
+#define SENSE_ZERO 1
+#define SENSE_POS  2
+
+static inline struct gene_action decide_action(uint8_t output, float in)
+{
+	struct gene_action a = { ACT_NONE, 0 };
+	unsigned int tmp;
+
+	switch(output) {
+		case GENE_MOVE_X:
+		if(in > 1.0)
+			a.op = ACT_MOVE_EAST;
+		else if(in < -1.0)
+			a.op = ACT_MOVE_WEST;
+		break;
+
+		case GENE_MOVE_Y:
+		if(in > 1.0)
+			a.op = ACT_MOVE_NORTH;
+		else if(in < -1.0)
+			a.op = ACT_MOVE_SOUTH;
+		break;
+
+		case GENE_MOVE_FORWARD:
+		if(in > 1.0)
+			a.op = ACT_MOVE_FORWARD;
+		else if(in < -1.0)
+			a.op = ACT_MOVE_BACKWARD;
+		break;
+
+		case GENE_COMMIT_SUICIDE:
+		if(fabsf(in) > 3.5f)
+			a.op = ACT_SUICIDE;
+		break;
+
+		case GENE_SET_OSCILATOR:
+		tmp = abs((int)(in * 100));
+
+		/* some weird sanitization */
+		if(in < 0.1 && in > -0.1 && tmp != 1)
+			break;
+
+		a.op = in < 0 ? ACT_OSC_NEG : ACT_OSC_POS;
+		a.osc = tmp;
+		break;
+
+		case GENE_KILL_FORWARD:
+		if(in < -2)
+			a.op = ACT_KILL_BACKWARD;
+		else if(in > 2)
+			a.op = ACT_KILL_FORWARD;
+		break;
+	}
+
+	return a;
+}
+
 /* strength uses the fp16 format
 *  so we need to be able to convert it to fp32
 */
 __attribute__ ((__pure__)) float strength_to_float(uint16_t strength);
 
-/* handles inheritance + mutation */
-void duplicate_genes(gene_t parent[4], gene_t child[4]);
+/* sanitizes the genes in place and decodes them */
+void decode_genes(gene_t genes[4], struct gene_prog prog[4]);
+/* the action of each gene for each discrete input */
+void compile_genes(const struct gene_prog prog[4],
+	struct gene_action act[4][3]);
+void compile_genes_fixed(const struct gene_prog prog[4],
+	struct gene_action act[4][3]);
+/* the handler of each gene, in cells.c with the inputs they're made of */
+void pick_handlers(const struct gene_prog prog[4], gene_handler handler[4]);
+/* the genes as lanes of thresholds */
+void vectorize_genes(const struct gene_prog prog[4],
+	struct gene_lanes *lanes);
+
+/*  true if none of the genes can ever fire, whatever they're fed, going by
+*   the fixed point strengths if fixed and the floats otherwise
+*/
+bool inert_genes(const struct gene_prog prog[4], bool fixed);
+
+/*  handles inheritance + mutation, returns true if the parent mutated. The
+*   dice are the key of the stream the mutations are rolled off, see
+*   cell_dice in world.h.
+*/
+bool duplicate_genes(gene_t parent[4], gene_t child[4], uint64_t dice);
 
 #endif
\ No newline at end of file
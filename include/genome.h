@@ -0,0 +1,67 @@
+/*  SPDX-License-Identifier: GPL-3.0-only
+*   Cellular life simulation following strict rules
+*   Copyright (C) 2023 Teresa Maria Rivera
+*/
+
+#ifndef CELLS_GENOME_H__
+#define CELLS_GENOME_H__
+
+#include <stdint.h>
+#include "include/genetics.h"
+
+/*  Every distinct genome is kept once, hash consed, and cells only hold the
+*   32 bit index of theirs. Nearly everybody descends from a handful of
+*   lineages and mutation is rare, so thousands of cells share one entry,
+*   along with anything worked out from the genes (like the decoded
+*   programs, or whether they can do anything at all). The number of live
+*   entries is the number of species.
+*
+*   Entries are refcounted by the cells using them, an entry nobody uses
+*   goes back on the free list, threaded through next.
+*/
+
+#define GENOME_NONE UINT32_MAX
+
+struct genome {
+	gene_t genes[4]; /* sanitized */
+	struct gene_prog prog[4];
+	struct gene_action act[4][3]; /* by gene and discrete input */
+	struct gene_action act_fixed[4][3];
+	struct gene_lanes lanes;
+	gene_handler handler[4];
+	bool inert; /* can't ever do anything, its cells get parked */
+	bool inert_fixed; /* the same for the fixed point gene modes */
+	uint32_t refs;
+	uint32_t next; /* next in the hash chain, or on the free list */
+};
+
+struct genome_table {
+	uint32_t capacity;
+	uint32_t top;   /* entries under this have been handed out */
+	uint32_t free;  /* first free entry, GENOME_NONE for none */
+	uint32_t count; /* live entries, aka species */
+
+	struct genome *genomes;
+
+	uint32_t *buckets;
+	uint32_t bucket_mask;
+};
+
+#define GENOME(t, g) ((t)->genomes[g])
+
+void genome_init(struct genome_table *t, uint32_t capacity);
+void genome_free_table(struct genome_table *t);
+
+/*  index of the entry for these genes, made if it's new, either way
+*   the caller holds a reference to it now
+*/
+uint32_t genome_intern(struct genome_table *t, const gene_t genes[4]);
+
+/*  room for n new entries without moving the table, so threads can read
+*   genomes while another one interns (under a lock)
+*/
+void genome_reserve(struct genome_table *t, uint32_t n);
+
+void genome_release(struct genome_table *t, uint32_t g);
+
+#endif
@@ -11,4 +11,38 @@
 float map_range(float x, float src1, float src2, float dst1, float dst2);
 __attribute__ ((__pure__)) uint32_t isqrt(uint32_t i);
 
+/*  Every bit of k stirred into every bit of what comes out, cheap enough to
+*   hash a cell and a step with for every roll
+*/
+static inline uint64_t mix64(uint64_t k)
+{
+	k ^= k >> 31;
+	k *= UINT64_C(0x9e3779b97f4a7c15);
+	k ^= k >> 29;
+	k *= UINT64_C(0xbf58476d1ce4e5b9);
+	return k ^ k >> 32;
+}
+
+/* the next of a stream of those, s is the key and counts along */
+static inline uint64_t mix64_next(uint64_t *s)
+{
+	return mix64(*s += UINT64_C(0x9e3779b97f4a7c15));
+}
+
+/*  Q16.16 fixed point. Floats and sinf can come out differently between
+*   libm versions and -march flags, integers can't, so GENES_FIXED steps
+*   with these and gets the same world on any x86-64.
+*/
+typedef int32_t fixed_t;
+
+#define FIXED_SHIFT 16
+#define FIXED_ONE   (1 << FIXED_SHIFT)
+#define FIXED_NAN   INT32_MIN /* a strength of nan or infinity */
+
+/* 4*sin(0.25*strength) for an fp16 strength, without touching floats */
+__attribute__ ((__pure__)) fixed_t strength_to_fixed(uint16_t strength);
+/* map_range, same formula, in integers */
+int64_t map_range_fixed(int64_t x, int64_t src1, int64_t src2,
+	int64_t dst1, int64_t dst2);
+
 #endif
\ No newline at end of file
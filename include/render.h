@@ -11,7 +11,8 @@
 
 #define RGBA(r, g, b, a) ((((r) & 0xff) << 24) | (((g) & 0xff) << 16) | (((b) & 0xff) << 8) | (a & 0xff))
 
-typedef uint32_t (*color_fn)(struct tile*);
+/* gets the color of tile i of the world */
+typedef uint32_t (*color_fn)(struct world*, size_t);
 
 struct render_settings {
 	/* 1 for rgb, 2 for rgba */
@@ -27,6 +28,6 @@ void *render(struct world *w, const char *filename,
 
 void free_render_buffer(void *renderbuf);
 
-uint32_t default_colorgen(struct tile *t);
+uint32_t default_colorgen(struct world *w, size_t i);
 
 #endif
\ No newline at end of file
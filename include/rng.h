@@ -16,6 +16,11 @@ void free_generator(generator_handle h);
 void reseed(generator_handle h);
 void refresh(generator_handle h);
 
+/* reseed off another generator instead of the OS, the same seed every time */
+void reseed_from(generator_handle h, generator_handle from);
+/* dst picks up exactly where src is */
+void copy_generator(generator_handle dst, generator_handle src);
+
 uint8_t gen8(generator_handle h);
 uint16_t gen16(generator_handle h);
 uint32_t gen32(generator_handle h);
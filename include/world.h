@@ -6,17 +6,215 @@
 #ifndef CELLS_WORLD_H__
 #define CELLS_WORLD_H__
 
+#include <stddef.h>
+#include <stdint.h>
 #include <stdbool.h>
 #include "include/cells.h"
+#include "include/genome.h"
+#include "include/math.h"
 
-#define INDEX_WORLD(w, x, y) (w.grid[(w.length * (y % w.height)) + (x % w.length)])
+/*  The planes are padded with a one tile ghost ring, the ring mirrors the
+*   type of the tile on the opposite edge. Reading a neighbour is just an
+*   offset from the tile's index, no wrapping, no modulo. Only the type is
+*   mirrored, anything that writes or reads more than the type of a
+*   neighbour has to get the real index from wrapped coordinates.
+*/
+
+/* index of the tile at x, y, both have to be inside the world already */
+#define INDEX_WORLD(w, x, y) \
+	((size_t)(w).stride * ((y) + 1) + ((x) + 1))
+
+/* wrapped coordinates of the next/previous tile, no division */
+#define WRAP_INC(v, n) ((v) + 1 == (n) ? 0 : (v) + 1)
+#define WRAP_DEC(v, n) ((v) == 0 ? (n) - 1 : (v) - 1)
+
+/* offset of the neighbour of a tile in a direction */
+#define OFFSET_NORTH(w) ((ptrdiff_t)(w).stride)
+#define OFFSET_SOUTH(w) (-(ptrdiff_t)(w).stride)
+#define OFFSET_EAST(w)  ((ptrdiff_t)1)
+#define OFFSET_WEST(w)  ((ptrdiff_t)-1)
+
+/*  The world is stored as a structure of arrays, every field of a tile gets
+*   its own plane indexed by the flat tile index. Anything that only needs the
+*   type of a tile (density, sensors, rendering, extinction checks) only has
+*   to pull the type plane through the cache instead of whole cells.
+*
+*   Cells themselves live in a pool, again one plane per field, and a tile
+*   holding a cell only stores the cell's 32 bit handle. Moving a cell is
+*   just moving its handle. The CELL_ accessors take a handle, not a tile.
+*/
+#define TILE_TYPE(w, i)      ((w)->type[i])
+#define TILE_HANDLE(w, i)    ((w)->handle[i])
+#define TILE_ENERGY(w, i)    ((w)->energy[i])
+
+/* compact tiles keep the id of dead things where a cell's handle would be */
+#ifdef CELLS_COMPACT
+#define TILE_ID(w, i)        ((w)->handle[i])
+#else
+#define TILE_ID(w, i)        ((w)->id[i])
+#endif
+
+#define CELL_TILE(w, h)      ((w)->pool.tile[h])
+#define CELL_ID(w, h)        ((w)->pool.id[h])
+#define CELL_ENERGY(w, h)    ((w)->pool.energy[h])
+#define CELL_AGE(w, h)       ((w)->pool.age[h])
+#define CELL_OSCIL_DUR(w, h) ((w)->pool.oscil_dur[h])
+#define CELL_OSCIL_CTR(w, h) ((w)->pool.oscil_ctr[h])
+#define CELL_GENOME(w, h)    ((w)->pool.genome[h])
+
+/* a cell's genes are its genome's, they're shared, don't write to them */
+#define CELL_GENES(w, h)     (GENOME(&(w)->genomes, CELL_GENOME(w, h)).genes)
+#define CELL_PROG(w, h)      (GENOME(&(w)->genomes, CELL_GENOME(w, h)).prog)
+#define CELL_ACT(w, h)       (GENOME(&(w)->genomes, CELL_GENOME(w, h)).act)
+#define CELL_ACT_FIXED(w, h) (GENOME(&(w)->genomes, CELL_GENOME(w, h)).act_fixed)
+#define CELL_LANES(w, h)     (GENOME(&(w)->genomes, CELL_GENOME(w, h)).lanes)
+#define CELL_INERT(w, h)     ((w)->gene_mode >= GENES_FIXED ? \
+	GENOME(&(w)->genomes, CELL_GENOME(w, h)).inert_fixed : \
+	GENOME(&(w)->genomes, CELL_GENOME(w, h)).inert)
+#define CELL_HANDLER(w, h)   (GENOME(&(w)->genomes, CELL_GENOME(w, h)).handler)
+
+#ifdef CELLS_COMPACT
+#define CELL_COMPASS(w, h)   ((w)->pool.flags[h].compass)
+#define CELL_UPDATED(w, h)   ((w)->pool.flags[h].updated)
+#else
+#define CELL_COMPASS(w, h)   ((w)->pool.compass[h])
+#define CELL_UPDATED(w, h)   ((w)->pool.updated[h])
+#endif
+#define CELL_ACTIONS(w, h)   ((w)->pool.actions[h])
+#define CELL_SINCE(w, h)     ((w)->pool.since[h])
+#define CELL_DEADLINE(w, h)  ((w)->pool.deadline[h])
+
+/*  A cell's actions hold how many it took this step in the low bits, and
+*   whether it's parked in the top ones. Parked cells have an inert genome,
+*   so all they'd ever do is get older and hungrier. They're skipped until
+*   their deadline, and their energy, age and oscillator are only brought
+*   up to date when something looks at them, see world_park_cell.
+*/
+#define ACTIONS_TAKEN  0x07
+#define CELL_DORMANT   0x80
+
+/*  Occupancy bitplanes, one bit per tile (ghost ring and all), one for tiles
+*   with a cell and one for tiles with a dead thing. They're kept in step with
+*   the type plane, and the sensors read them instead of the type plane.
+*   The neighbour counts are kept per 64 tile word, sliced over four words
+*   (bit n of the count of tile i is bit i%64 of nbr[i/64][n]), and get
+*   recounted with bit parallel adders when a cell around them changes.
+*/
+#define TILE_BIT(plane, i) (((plane)[(i) >> 6] >> ((i) & 63)) & 1)
+#define IS_ALIVE(w, i)     TILE_BIT((w)->alive_bits, i)
+#define IS_FOOD(w, i)      TILE_BIT((w)->food_bits, i)
+
+/*  Everything a cell can sense about the tiles around it, packed into a
+*   sensor word per tile: food and cells to the north, south, west and east
+*   (one bit each, by compass point) and the live neighbour count. They're
+*   built 64 tiles at a time straight off the bitplanes and the neighbour
+*   counts, and go stale the same way the counts do, so four genes reading
+*   their inputs cost one load instead of a pile of scattered tile reads.
+*/
+#define SENSOR_FOOD(compass)  (1u << ((compass) - 1))
+#define SENSOR_ALIVE(compass) (1u << ((compass) + 3))
+#define SENSOR_NBR_SHIFT      8
+#define SENSOR_NBR(s)         ((s) >> SENSOR_NBR_SHIFT)
+
+/*  Free tiles get a bitplane of their own, in the same layout but only ever
+*   set for real tiles with nothing on them. The free tiles are also counted
+*   per block of FREE_BLOCK_WORDS words in a Fenwick tree, so the n'th free
+*   tile can be found in O(log n) and placing things at random doesn't have
+*   to keep rolling until it hits an empty tile.
+*/
+#define FREE_BLOCK_WORDS 8
+#define NO_TILE SIZE_MAX
+
+/*  how step_world walks the world, STEP_DENSE unless asked. Children get
+*   stepped the step they're born if a raster walk comes across them, the
+*   other modes keep them waiting for the next one.
+*/
+#define STEP_DENSE  0 /* every tile in raster order, the old way */
+#define STEP_ACTIVE 1 /* only the live cells, straight out of the pool */
+#define STEP_INTENT 2 /* every cell decides off the last step, then commit */
+#define STEP_STRIPES 3 /* STEP_ACTIVE a stripe of rows at a time, on threads */
+#define STEP_SPECULATE 4 /* STEP_DENSE's order on threads, redone if need be */
+
+/*  the order STEP_DENSE goes through the tiles in. Row after row is hard
+*   on the caches once a row gets wide, by the time the next row comes
+*   around the row above is long gone. Squares of ORDER_BLOCK keep the rows
+*   around the cells being stepped cached, and going through the squares
+*   in Z-order keeps the squares around it cached too.
+*
+*   Either way the cells up and to the left go first every step, and get
+*   to the food, the fights and the room for children first. Shuffling
+*   the squares and the tiles in each, differently every step, evens that
+*   out without an array of every tile to shuffle.
+*/
+#define ORDER_RASTER   0 /* row after row, all the way across, the old way */
+#define ORDER_BLOCKED  1 /* ORDER_BLOCK squares in Z-order, raster in each */
+#define ORDER_SHUFFLED 2 /* ORDER_BLOCK squares and their tiles, at random */
+#define ORDER_BLOCK 64
+
+/*  how step_cell runs genes, GENES_DECODED unless asked. GENES_FIXED and
+*   GENES_TABLE step differently from the float ones, a strength rounds
+*   the other way now and then, so they only run when picked.
+*/
+#define GENES_DECODED  0 /* read the input, scale it, decide, every time */
+#define GENES_COMPILED 1 /* look discrete inputs up in the genome's actions */
+#define GENES_VECTOR   2 /* all four genes at once in an SSE register */
+#define GENES_FIXED    3 /* compiled, but fixed point, the same everywhere */
+#define GENES_TABLE    4 /* fixed, through a handler for the gene's opcodes */
+
+/*  a free slot in the pool has this bit set in its tile, the rest of the
+*   tile is the next free slot
+*/
+#define POOL_FREE (UINT32_C(1) << 31)
+#define POOL_END  (~POOL_FREE)
 
-struct tile {
-	uint8_t type; /* 0 for nothing, 1 for dead stuff, 2 for cell */
-	union {
-		struct cell cell;
-		struct dead_thing dead;
-	};
+struct intent;
+struct intent_key;
+struct stripes;
+struct speculation;
+struct slice;
+struct undo;
+
+#ifdef CELLS_COMPACT
+/* compass and the updated flag share a byte */
+struct cell_flags {
+	uint8_t compass : 3;
+	uint8_t updated : 1;
+};
+#endif
+
+struct cell_pool {
+	uint32_t capacity;
+	uint32_t top;  /* slots under this have been handed out at some point */
+	uint32_t free; /* first free slot below top, POOL_END for none */
+	uint32_t count;
+
+	uint32_t *tile;
+	cell_id_t *id;
+	energy_t *energy;
+	age_t *age;
+	oscil_t *oscil_dur;
+	oscil_t *oscil_ctr;
+	uint32_t *genome; /* index into the world's genome table */
+#ifdef CELLS_COMPACT
+	struct cell_flags *flags;
+#else
+	uint8_t *compass;
+	bool *updated;
+#endif
+	uint8_t *actions; /* taken this step, metabolism charges for them */
+	uint32_t *since;    /* parked cells are up to date as of this step */
+	uint32_t *deadline; /* and have to be woken up on this one */
+};
+
+/*  Running totals, kept up to date by everything that adds, removes or feeds
+*   a cell or a dead thing, so nobody has to scan the world to know them.
+*   make DEBUG=1 checks them against a full scan after every step.
+*/
+struct census {
+	uint32_t cells;
+	size_t dead;
+	uint64_t cell_energy;
+	uint64_t dead_energy;
 };
 
 struct world {
@@ -25,7 +223,68 @@ struct world {
 
 	unsigned int length;
 	unsigned int height;
-	struct tile *grid;
+
+	/* length + 2, and its reciprocal for dividing by it quickly */
+	unsigned int stride;
+	uint64_t stride_magic;
+
+	/* offset to the neighbour in the direction of each compass point */
+	ptrdiff_t forward[5];
+
+	uint8_t *type; /* 0 for nothing, 1 for dead stuff, 2 for cell */
+	uint32_t *handle; /* the cell on the tile */
+
+	size_t bit_words;
+	uint64_t *alive_bits;
+	uint64_t *food_bits;
+	uint64_t (*nbr)[4];
+	bool *nbr_stale;
+	uint16_t *sensors;
+	bool *sensors_stale;
+
+	uint64_t *free_bits;
+	uint32_t *free_tree; /* 1 based, free_blocks long */
+	size_t free_blocks;
+	size_t free_count;
+
+	/* dead things */
+#ifndef CELLS_COMPACT
+	cell_id_t *id;
+#endif
+	energy_t *energy;
+
+	/*  Cells have been updated this step when their updated flag matches
+	*   this, it flips every step so nobody has to clear the flags.
+	*/
+	bool parity;
+
+	int step_mode;
+	int order; /* of STEP_DENSE, see ORDER_RASTER */
+	int gene_mode;
+	bool dormancy; /* park inert cells, on by default, only changes speed */
+
+	/*  threads STEP_STRIPES and STEP_SPECULATE run on, 0 for one per cpu,
+	*   see stripes.c and speculate.c
+	*/
+	unsigned int threads;
+	struct stripes *stripes;
+	struct speculation *speculation;
+
+	/* cells that starved or got too old this step, see metabolise */
+	uint32_t *dying;
+	uint32_t dying_capacity;
+
+	/*  what every cell wants to do this step under STEP_INTENT, and who
+	*   got to each contested tile first, see cells.c
+	*/
+	struct intent *intents;
+	struct intent_key *intent_order;
+	uint32_t intents_capacity;
+	uint32_t *claims;
+
+	struct cell_pool pool;
+	struct genome_table genomes;
+	struct census census;
 };
 
 struct statistics {
@@ -37,16 +296,300 @@ struct statistics {
 	unsigned int starve;
 	unsigned int suicide;
 	unsigned int births;
+	unsigned int species;
 };
 
-void init_world(struct world *w, unsigned int x, unsigned int y, 
+/* a run of steps from step_world_n, lowest only means anything once steps */
+struct run_totals {
+	uint64_t steps;
+	struct statistics highest;
+	struct statistics lowest;
+	struct statistics total;
+};
+
+/* step_world_n flags */
+#define RUN_STOP_EXTINCT 1 /* stop after the step that kills the last cell */
+
+/*  Rows a cell can reach past its stripe in a step: a move for each of its
+*   four genes, then one tile past that, for a kill, a child or the cached
+*   counts and sensors around where it ended up
+*/
+#define STEP_REACH (4 + 1)
+
+/* slots a stripe gets for children, births are rare, more is a redo */
+#define WORKER_SLOTS 4
+
+/*  A child conceived on a stripe under STEP_STRIPES that ran out of slots,
+*   paid for and rolled when its parent asked, born into a slot once the
+*   stripe's colour is done
+*/
+struct birth {
+	struct cell child;
+	gene_t parent_genes[4]; /* mutated along with the child's */
+	bool mutated;
+	uint32_t parent;
+	uint32_t tile;
+};
+
+/*  What a stripe keeps to itself while it's stepped, so the threads don't
+*   all write to the same census and stats. They don't touch the pool
+*   either: children go in slots set aside for the stripe, and births past
+*   those and freed slots wait in here until every thread is done with the
+*   stripes it's on. Genomes are interned and dropped under a lock.
+*/
+struct worker {
+	struct census census; /* changes to the world's */
+	struct statistics stats;
+
+	struct birth *births;
+	uint32_t n_births;
+	uint32_t births_capacity;
+
+	uint32_t *freed;
+	uint32_t n_freed;
+	uint32_t freed_capacity;
+
+	/*  Children are born right away, into slots set aside before the
+	*   threads start. Under STEP_SPECULATE the stripe also keeps a journal
+	*   of everything it overwrote in case it has to be redone.
+	*/
+	struct slice *slice; /* NULL under STEP_STRIPES */
+	bool journal;
+	bool alone;  /* nobody else is stepping, it can go to the pool */
+	bool broken; /* ran out of slots, it has to be redone alone */
+	uint8_t n_slots;
+	uint8_t used_slots;
+	uint32_t slots[WORKER_SLOTS];
+
+	struct undo *undo;
+	uint32_t n_undo;
+	uint32_t undo_capacity;
+} __attribute__((__aligned__(64)));
+
+/* the worker this thread is, NULL unless it's stepping a stripe */
+extern _Thread_local struct worker *this_worker;
+
+/* where the census changes made by this thread go */
+static inline struct census *census(struct world *w)
+{
+	return this_worker ? &this_worker->census : &w->census;
+}
+
+/* padded row of tile i, 1 to height, exact for any index under 2^32 */
+static inline uint32_t world_row(const struct world *w, size_t i)
+{
+	return ((unsigned __int128)w->stride_magic * (uint32_t)i) >> 64;
+}
+
+void world_count_neighbours(struct world *w, size_t k);
+
+/* number of live cells around tile i */
+static inline unsigned int world_neighbours(struct world *w, size_t i)
+{
+	size_t k = i >> 6;
+	unsigned int b = i & 63;
+
+	if(w->nbr_stale[k])
+		world_count_neighbours(w, k);
+
+	return ((w->nbr[k][0] >> b) & 1) |
+		(((w->nbr[k][1] >> b) & 1) << 1) |
+		(((w->nbr[k][2] >> b) & 1) << 2) |
+		(((w->nbr[k][3] >> b) & 1) << 3);
+}
+
+/* every change to a live cell's energy goes through here for the census */
+static inline void cell_set_energy(struct world *w, uint32_t h, energy_t e)
+{
+	census(w)->cell_energy += (int64_t)e - (int64_t)CELL_ENERGY(w, h);
+	CELL_ENERGY(w, h) = e;
+}
+
+void world_count_sensors(struct world *w, size_t k);
+
+/* the sensor word of tile i */
+static inline uint16_t world_sensors(struct world *w, size_t i)
+{
+	if(w->sensors_stale[i >> 6])
+		world_count_sensors(w, i >> 6);
+
+	return w->sensors[i];
+}
+
+/* energy only ever saturates, it never wraps around when gained */
+static inline void cell_gain(struct world *w, uint32_t h, uint32_t energy)
+{
+	uint64_t sum = (uint64_t)CELL_ENERGY(w, h) + energy;
+	cell_set_energy(w, h, sum > ENERGY_MAX ? ENERGY_MAX : sum);
+}
+
+/* the other way, bottoming out at 0 and leaving starving to metabolise */
+static inline void cell_lose(struct world *w, uint32_t h, uint32_t energy)
+{
+	energy_t e = CELL_ENERGY(w, h);
+	cell_set_energy(w, h, energy < e ? e - energy : 0);
+}
+
+/*  The dice a cell rolls on a step: having a child, dying at random past
+*   1116, what the child gets. They're hashed off the cell's id, the step
+*   and what the roll is for instead of drawn from main_rng, so a cell rolls
+*   the same no matter what got stepped before it or on which thread, and
+*   every step mode rolls the ones STEP_DENSE does.
+*/
+#define DICE_BIRTH UINT64_C(0x6269727468) /* "birth" */
+#define DICE_DEATH UINT64_C(0x6465617468) /* "death" */
+#define DICE_CHILD UINT64_C(0x6368696c64) /* "child", its id and genes */
+
+static inline uint64_t cell_dice(struct world *w, uint32_t h,
+	uint32_t step, uint64_t what)
+{
+	return mix64(mix64((uint64_t)CELL_ID(w, h) ^ what) ^ step);
+}
+
+/* ser in ascii, Spanish for "to be", 2^-24 a step */
+static inline bool birth_roll(struct world *w, uint32_t h, uint32_t step)
+{
+	return (cell_dice(w, h, step, DICE_BIRTH) & 0x00ffffff) == 0x736572;
+}
+
+/* die! in ascii, 2^-32 a step */
+static inline bool death_roll(struct world *w, uint32_t h, uint32_t step)
+{
+	return (uint32_t)cell_dice(w, h, step, DICE_DEATH) == 0x64696521;
+}
+
+/* parked, and not due to wake up this step */
+static inline bool cell_asleep(struct world *w, uint32_t h)
+{
+	return (CELL_ACTIONS(w, h) & CELL_DORMANT) &&
+		(int32_t)(CELL_DEADLINE(w, h) - w->iters) > 0;
+}
+
+void init_world(struct world *w, unsigned int x, unsigned int y,
 	unsigned int i, unsigned int c);
 void step_world(struct world *w, struct statistics *stats);
+/*  up to n steps in one go, folded into t, which starts zeroed and can be
+*   handed in again to carry on. Returns how many steps were taken.
+*/
+unsigned int step_world_n(struct world *w, unsigned int n,
+	struct run_totals *t, int flags);
 void free_world(struct world *w);
 
 bool world_has_life(struct world *w);
+/* dies if the census doesn't match a full scan of the world */
+void world_check_census(struct world *w);
+
+/* a uniformly random free tile, NO_TILE when the world is full */
+size_t world_random_free(struct world *w);
+/* put down up to n pieces of food on free tiles, returns how many fit */
+size_t world_place_food(struct world *w, size_t n);
+
+/* gather/scatter a whole cell, for the places that need all of it */
+void world_load_cell(struct world *w, size_t i, struct cell *c);
+uint32_t world_store_cell(struct world *w, size_t i, const struct cell *c);
+void world_store_dead(struct world *w, size_t i, const struct dead_thing *d);
+
+/* move the cell on tile src to dst, leaving src empty */
+void world_move_cell(struct world *w, size_t dst, size_t src);
+
+/*  Put a freed slot back in the pool, for whoever freed it while stepping a
+*   stripe. Until then the slot's tile is POOL_FREE | POOL_END.
+*/
+void world_release_cell(struct world *w, uint32_t h);
+/* rebuild the free tile counts off the free bitplane */
+void world_recount_free(struct world *w);
 
-void step_cell(struct tile *t, struct world *w, struct statistics *stats,
+/* the cell at i dies, leaving behind a dead thing */
+void world_kill_cell(struct world *w, size_t i);
+/* the cell at i is gone without a trace */
+void world_remove_cell(struct world *w, size_t i);
+/* the dead thing at i got eaten */
+void world_remove_dead(struct world *w, size_t i);
+
+/*  Park the cell in slot h for as long as nothing can happen to it, it
+*   must have an inert genome and be done with this step. Waking it up
+*   brings it up to date as of the last step, whatever it was due for is
+*   left to its turn and the metabolism, same as if it had never slept.
+*/
+void world_park_cell(struct world *w, uint32_t h);
+void world_wake_cell(struct world *w, uint32_t h);
+/* bring every parked cell up to date without waking them, between steps */
+void world_sync(struct world *w);
+
+void step_cell(struct world *w, struct statistics *stats,
 	uint32_t x, uint32_t y);
 
-#endif
\ No newline at end of file
+/*  STEP_INTENT in two halves. intend_cells only reads the world as it was
+*   after the last step, draws nothing from main_rng (birth rolls are keyed
+*   by cell and step), and notes down what every cell wants to do, then
+*   commit_intents settles who gets which tile and carries it all out.
+*   intend_cells returns how many intents there are.
+*/
+uint32_t intend_cells(struct world *w);
+void commit_intents(struct world *w, struct statistics *stats, uint32_t n);
+
+/* the cell in slot c has a child on tile n, if there's room for one */
+void give_birth(struct world *w, struct statistics *stats,
+	uint32_t c, size_t n);
+/*  The same in two halves, for STEP_STRIPES. conceive_child is all of it
+*   that only touches the parent and the nursery: it eats what's there, pays
+*   for the child and rolls who the child is, returning whether the parent's
+*   genes mutated too. deliver_child takes the slot and the genomes.
+*/
+bool conceive_child(struct world *w, uint32_t c, size_t n,
+	struct cell *child, gene_t parent[4]);
+void deliver_child(struct world *w, struct statistics *stats, uint32_t c,
+	size_t n, const struct cell *child, const gene_t parent[4],
+	bool mutated);
+
+/*  STEP_STRIPES, false if the world is too small to split up, then it's
+*   up to the caller to step it. free_stripes stops the threads.
+*/
+bool step_stripes(struct world *w, struct statistics *stats);
+void free_stripes(struct world *w);
+void worker_defer_birth(struct world *w, struct worker *k, uint32_t parent,
+	size_t n);
+void worker_defer_free(struct worker *k, uint32_t h);
+
+/*  STEP_SPECULATE, false if the world is too small to split up, like
+*   step_stripes. speculation_counts says how many runs of a stripe there
+*   were so far and how many of them got rolled back.
+*/
+bool step_speculate(struct world *w, struct statistics *stats);
+void free_speculation(struct world *w);
+void speculation_counts(const struct world *w, uint64_t *runs,
+	uint64_t *redone);
+/*  notes down for the stripe's run that a cell acts from tile t, that it
+*   wrote the tile at t, and that it had a child on tile n, which might be
+*   past its rows
+*/
+void slice_mark(struct world *w, struct slice *s, size_t t);
+void slice_wrote(struct world *w, struct slice *s, size_t t);
+void slice_born(struct world *w, struct slice *s, size_t n);
+
+/*  The journal, for the worker this thread is, when it keeps one. A cell
+*   has to be saved before anything in its slot changes, tiles save
+*   themselves. world_undo rolls the whole run back, newest first, and
+*   world_commit does what was put off until the run was known to be good.
+*/
+void world_save_cell(struct world *w, uint32_t h);
+void world_undo(struct world *w, struct worker *k);
+void world_commit(struct world *w, struct worker *k);
+
+/*  genome_intern and genome_release for the genes of a live cell, the
+*   release waits for world_commit when there's a journal
+*/
+uint32_t world_intern_genome(struct world *w, const gene_t genes[4]);
+void world_drop_genome(struct world *w, uint32_t g);
+
+/* set aside a worker's slots for children, and give back the unused ones */
+void world_reserve_slots(struct world *w, struct worker *k, uint8_t n);
+void world_return_slots(struct world *w, struct worker *k);
+
+/* whether a birth can go ahead on this thread right now */
+static inline bool worker_has_slot(struct worker *k)
+{
+	return k == NULL || k->alone || k->used_slots < k->n_slots;
+}
+
+#endif
@@ -0,0 +1,461 @@
+/*  SPDX-License-Identifier: GPL-3.0-only
+*   Cellular life simulation following strict rules
+*   Copyright (C) 2023 Teresa Maria Rivera
+*/
+
+/*  Throughput benchmark for the stepping code, not part of the simulation.
+*   usage: bench [size] [steps]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "include/world.h"
+#include "include/cpu.h"
+#include "include/rng.h"
+#include "include/util.h"
+
+_Thread_local generator_handle main_rng;
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* returns the average time per step in milliseconds */
+static double time_steps(struct world *w, unsigned int steps)
+{
+	struct statistics stats;
+	double start = now();
+
+	for(unsigned int i = 0; i < steps; i++) {
+		ZERO_STRUCT(stats);
+		step_world(w, &stats);
+	}
+
+	return (now() - start) * 1000.0 / steps;
+}
+
+static void print_footprint(unsigned int size)
+{
+	struct world w;
+	size_t tile, cell;
+
+	tile = sizeof(*w.type) + sizeof(*w.handle) + sizeof(*w.energy);
+	cell = sizeof(*w.pool.tile) + sizeof(*w.pool.id) +
+		sizeof(*w.pool.energy) + sizeof(*w.pool.age) +
+		sizeof(*w.pool.oscil_dur) + sizeof(*w.pool.oscil_ctr) +
+		sizeof(*w.pool.genome) + sizeof(*w.pool.actions) +
+		sizeof(*w.pool.since) + sizeof(*w.pool.deadline);
+#ifdef CELLS_COMPACT
+	cell += sizeof(*w.pool.flags);
+	puts("compact layout");
+#else
+	tile += sizeof(*w.id);
+	cell += sizeof(*w.pool.compass) + sizeof(*w.pool.updated);
+	puts("full layout");
+#endif
+
+	printf("%zu bytes per tile, %zu bytes per cell, "
+		"%zu bytes per genome\n", tile, cell, sizeof(struct genome));
+	printf("a %ux%u world at 10%% population takes %.1f MiB\n\n",
+		size, size,
+		((double)size * size * tile + size * size / 10.0 * cell) /
+			(1024 * 1024));
+}
+
+static void bench_step_modes(unsigned int size, unsigned int steps)
+{
+	static const double densities[] = { 0.001, 0.01, 0.05, 0.2, 0.5 };
+
+	puts("step_world, dense raster walk vs active cells vs intents");
+	printf("%-10s %-10s %-14s %-14s %-14s %s\n",
+		"density", "cells", "dense ms/step", "active ms/step",
+		"intent ms/step", "speedup");
+
+	for(size_t i = 0; i < sizeof(densities)/sizeof(*densities); i++) {
+		unsigned int cells = densities[i] * size * size;
+		double dense, active, intent;
+		struct world w;
+
+		init_world(&w, size, size, 0, cells);
+		w.step_mode = STEP_DENSE;
+		dense = time_steps(&w, steps);
+		free_world(&w);
+
+		init_world(&w, size, size, 0, cells);
+		w.step_mode = STEP_ACTIVE;
+		active = time_steps(&w, steps);
+		free_world(&w);
+
+		init_world(&w, size, size, 0, cells);
+		w.step_mode = STEP_INTENT;
+		intent = time_steps(&w, steps);
+		free_world(&w);
+
+		printf("%-10.3f %-10u %-14.3f %-14.3f %-14.3f %.2fx\n",
+			densities[i], cells, dense, active, intent,
+			dense / active);
+	}
+}
+
+/*  STEP_DENSE row by row against square by square, the wider the world the
+*   less of the rows around a cell is still cached by the time it's stepped
+*/
+static void bench_orders(unsigned int size, unsigned int steps)
+{
+	static const double densities[] = { 0.01, 0.05, 0.2 };
+
+	puts("\nstep_world with STEP_DENSE, raster vs blocked vs shuffled order");
+	printf("%-10s %-10s %-16s %-16s %-16s %s\n",
+		"density", "cells", "raster ms/step", "blocked ms/step",
+		"shuffled ms/step", "speedup");
+
+	for(size_t i = 0; i < sizeof(densities)/sizeof(*densities); i++) {
+		unsigned int cells = densities[i] * size * size;
+		double raster, blocked, shuffled;
+		struct world w;
+
+		init_world(&w, size, size, 0, cells);
+		w.step_mode = STEP_DENSE;
+		raster = time_steps(&w, steps);
+		free_world(&w);
+
+		init_world(&w, size, size, 0, cells);
+		w.step_mode = STEP_DENSE;
+		w.order = ORDER_BLOCKED;
+		blocked = time_steps(&w, steps);
+		free_world(&w);
+
+		init_world(&w, size, size, 0, cells);
+		w.step_mode = STEP_DENSE;
+		w.order = ORDER_SHUFFLED;
+		shuffled = time_steps(&w, steps);
+		free_world(&w);
+
+		printf("%-10.3f %-10u %-16.3f %-16.3f %-16.3f %.2fx\n",
+			densities[i], cells, raster, blocked, shuffled,
+			raster / blocked);
+	}
+}
+
+static void bench_gene_modes(unsigned int size, unsigned int steps)
+{
+	static const double densities[] = { 0.01, 0.2, 0.5 };
+	static const int modes[] = {
+		GENES_DECODED, GENES_COMPILED, GENES_VECTOR, GENES_FIXED,
+		GENES_TABLE
+	};
+
+	puts("\nstep_cell, ms/step by how genes are run");
+	printf("%-10s %-10s %-10s %-10s %-10s %-10s %s\n",
+		"density", "cells", "decoded", "compiled", "vector", "fixed",
+		"table");
+
+	for(size_t i = 0; i < sizeof(densities)/sizeof(*densities); i++) {
+		unsigned int cells = densities[i] * size * size;
+
+		printf("%-10.3f %-10u", densities[i], cells);
+		for(size_t m = 0; m < sizeof(modes)/sizeof(*modes); m++) {
+			struct world w;
+
+			init_world(&w, size, size, 0, cells);
+			w.step_mode = STEP_ACTIVE;
+			w.gene_mode = modes[m];
+			printf(" %-10.3f", time_steps(&w, steps));
+			free_world(&w);
+		}
+		putchar('\n');
+	}
+}
+
+/*  Random genomes are hardly ever inert, evolved ones often are. Give a
+*   share of the cells one that's about as inert as it gets.
+*/
+static void make_inert(struct world *w, double share)
+{
+	static const gene_t inert[4] = { 0, 0, 0, 0 };
+
+	for(uint32_t h = 0; h < w->pool.top; h++) {
+		if((CELL_TILE(w, h) & POOL_FREE) ||
+			gen32(main_rng) > share * UINT32_MAX)
+			continue;
+
+		genome_release(&w->genomes, CELL_GENOME(w, h));
+		CELL_GENOME(w, h) = genome_intern(&w->genomes, inert);
+	}
+}
+
+static void bench_dormancy(unsigned int size, unsigned int steps)
+{
+	static const double shares[] = { 0.0, 0.5, 0.9, 0.99 };
+	unsigned int cells = 0.2 * size * size;
+
+	puts("\nstep_world at 0.2 density, parking cells with inert genomes");
+	printf("%-10s %-14s %-14s %s\n",
+		"inert", "awake ms/step", "parked ms/step", "speedup");
+
+	for(size_t i = 0; i < sizeof(shares)/sizeof(*shares); i++) {
+		double awake, parked;
+		struct world w;
+
+		init_world(&w, size, size, 0, cells);
+		make_inert(&w, shares[i]);
+		w.step_mode = STEP_ACTIVE;
+		w.dormancy = false;
+		awake = time_steps(&w, steps);
+		free_world(&w);
+
+		init_world(&w, size, size, 0, cells);
+		make_inert(&w, shares[i]);
+		w.step_mode = STEP_ACTIVE;
+		parked = time_steps(&w, steps);
+		free_world(&w);
+
+		printf("%-10.2f %-14.3f %-14.3f %.2fx\n",
+			shares[i], awake, parked, awake / parked);
+	}
+}
+
+/*  Two worlds stepped from the same seed, tile for tile and cell for cell,
+*   and the census. Slots can differ, what's in them can't.
+*/
+static bool same_world(struct world *a, struct world *b)
+{
+	world_sync(a);
+	world_sync(b);
+
+	if(a->census.cells != b->census.cells ||
+		a->census.dead != b->census.dead ||
+		a->census.cell_energy != b->census.cell_energy ||
+		a->census.dead_energy != b->census.dead_energy)
+		return false;
+
+	for(size_t i = 0; i < (size_t)a->stride * (a->height + 2); i++) {
+		uint32_t p, q;
+
+		if(TILE_TYPE(a, i) != TILE_TYPE(b, i))
+			return false;
+		if(TILE_TYPE(a, i) == 1 && TILE_ENERGY(a, i) != TILE_ENERGY(b, i))
+			return false;
+		if(TILE_TYPE(a, i) != 2)
+			continue;
+
+		p = TILE_HANDLE(a, i);
+		q = TILE_HANDLE(b, i);
+		if(CELL_ID(a, p) != CELL_ID(b, q) ||
+			CELL_ENERGY(a, p) != CELL_ENERGY(b, q) ||
+			CELL_AGE(a, p) != CELL_AGE(b, q) ||
+			memcmp(CELL_GENES(a, p), CELL_GENES(b, q),
+				sizeof(CELL_GENES(a, p))))
+			return false;
+	}
+
+	return true;
+}
+
+/*  STEP_STRIPES against STEP_ACTIVE, doubling the threads up to the cpus.
+*   Every run starts from the same seed and has to end up with the same
+*   world as the one on one thread.
+*/
+static void bench_stripes(unsigned int size, unsigned int steps)
+{
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	unsigned int cells = 0.2 * size * size;
+	generator_handle seed = new_generator();
+	struct world one, w;
+	double active;
+
+	printf("\nstep_world at 0.2 density in stripes, %ld cpus\n", cpus);
+	printf("%-10s %-14s %s\n", "threads", "ms/step", "speedup");
+
+	init_world(&w, size, size, 0, cells);
+	w.step_mode = STEP_ACTIVE;
+	active = time_steps(&w, steps);
+	free_world(&w);
+	printf("%-10s %-14.3f %.2fx\n", "active", active, 1.0);
+
+	copy_generator(seed, main_rng);
+	for(long threads = 1; threads <= (cpus > 2 ? cpus : 2); threads *= 2) {
+		struct world *run = threads == 1 ? &one : &w;
+		double striped;
+
+		copy_generator(main_rng, seed);
+		init_world(run, size, size, 0, cells);
+		run->step_mode = STEP_STRIPES;
+		run->threads = threads;
+		striped = time_steps(run, steps);
+		if(run != &one) {
+			die(!same_world(&one, &w),
+				"STEP_STRIPES came out different on more threads");
+			free_world(&w);
+		}
+
+		printf("%-10ld %-14.3f %.2fx\n", threads, striped,
+			active / striped);
+	}
+
+	free_world(&one);
+	free_generator(seed);
+}
+
+/*  STEP_SPECULATE against STEP_DENSE, whose order it keeps, and how many
+*   of the stripes' runs had to be redone, crowded seams clash more often.
+*   Every run starts from the dense one's seed and has to end up with the
+*   very same world.
+*/
+static void bench_speculate(unsigned int size, unsigned int steps)
+{
+	static const double densities[] = { 0.02, 0.2 };
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	generator_handle seed = new_generator();
+
+	printf("\nstep_world speculating on stripes, %ld cpus\n", cpus);
+	printf("%-10s %-10s %-14s %-10s %s\n",
+		"density", "threads", "ms/step", "speedup", "redone");
+
+	for(size_t i = 0; i < sizeof(densities)/sizeof(*densities); i++) {
+		unsigned int cells = densities[i] * size * size;
+		double dense;
+		struct world d, w;
+
+		copy_generator(seed, main_rng);
+		init_world(&d, size, size, 0, cells);
+		d.step_mode = STEP_DENSE;
+		dense = time_steps(&d, steps);
+		printf("%-10.2f %-10s %-14.3f %.2fx\n",
+			densities[i], "dense", dense, 1.0);
+
+		for(long threads = 1; threads <= (cpus > 2 ? cpus : 2);
+			threads *= 2) {
+			uint64_t runs, redone;
+			double speculated;
+
+			copy_generator(main_rng, seed);
+			init_world(&w, size, size, 0, cells);
+			w.step_mode = STEP_SPECULATE;
+			w.threads = threads;
+			speculated = time_steps(&w, steps);
+			speculation_counts(&w, &runs, &redone);
+			die(!same_world(&d, &w),
+				"STEP_SPECULATE came out different from STEP_DENSE");
+			free_world(&w);
+
+			printf("%-10.2f %-10ld %-14.3f %-10.2f %.1f%%\n",
+				densities[i], threads, speculated,
+				dense / speculated,
+				runs ? 100.0 * redone / runs : 0.0);
+		}
+
+		free_world(&d);
+	}
+
+	free_generator(seed);
+}
+
+/*  A step_world loop keeping its own highest/lowest/totals, the way main
+*   used to, against step_world_n. It only shows on small worlds, where a
+*   step is short enough for the bookkeeping around it to count.
+*/
+static void bench_fused(unsigned int steps)
+{
+	static const unsigned int sizes[] = { 16, 64, 256 };
+
+	puts("\nstep_world in a loop vs step_world_n, 0.2 density");
+	printf("%-10s %-10s %-14s %-14s %s\n",
+		"size", "steps", "loop us/step", "fused us/step", "speedup");
+
+	for(size_t i = 0; i < sizeof(sizes)/sizeof(*sizes); i++) {
+		unsigned int size = sizes[i], cells = 0.2 * size * size;
+		unsigned int n = steps * (1u << 20) / (size * size), s, ran;
+		struct statistics stats, highest, lowest, total;
+		struct run_totals totals;
+		double start, loop, fused;
+		struct world w;
+
+		init_world(&w, size, size, 0, cells);
+		ZERO_STRUCT(highest);
+		memset(&lowest, 0xff, sizeof(lowest));
+		ZERO_STRUCT(total);
+		start = now();
+		for(s = 0; s < n; s++) {
+			ZERO_STRUCT(stats);
+			step_world(&w, &stats);
+#define KEEP(f) highest.f = stats.f > highest.f ? stats.f : highest.f; \
+	lowest.f = stats.f < lowest.f ? stats.f : lowest.f; total.f += stats.f;
+			KEEP(pop) KEEP(death) KEEP(food) KEEP(old_age) KEEP(murder)
+			KEEP(starve) KEEP(suicide) KEEP(births) KEEP(species)
+#undef KEEP
+			if(!world_has_life(&w)) {
+				s++;
+				break;
+			}
+		}
+		loop = (now() - start) * 1e6 / s;
+		free_world(&w);
+
+		init_world(&w, size, size, 0, cells);
+		ZERO_STRUCT(totals);
+		start = now();
+		ran = step_world_n(&w, n, &totals, RUN_STOP_EXTINCT);
+		fused = (now() - start) * 1e6 / ran;
+		free_world(&w);
+
+		printf("%-10u %-10u %-14.3f %-14.3f %.2fx\n",
+			size, ran, loop, fused, loop / fused);
+	}
+}
+
+/* food placement has to cost the same no matter how full the world is */
+static void bench_placement(unsigned int size)
+{
+	static const double fills[] = { 0.0, 0.5, 0.9, 0.99 };
+	size_t n = (size_t)size * size / 200 + 1;
+
+	puts("\nworld_place_food by how full the world already is");
+	printf("%-10s %-10s %s\n", "fill", "placed", "ns/placement");
+
+	for(size_t i = 0; i < sizeof(fills)/sizeof(*fills); i++) {
+		/* init_world puts down a quarter as much food as cells */
+		unsigned int cells = fills[i] * size * size / 1.25;
+		size_t placed;
+		double start;
+		struct world w;
+
+		init_world(&w, size, size, 0, cells ? cells : 1);
+		start = now();
+		placed = world_place_food(&w, n);
+		printf("%-10.2f %-10zu %.1f\n", fills[i], placed,
+			(now() - start) * 1e9 / placed);
+		free_world(&w);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int size = argc > 1 ? strtoul(argv[1], NULL, 0) : 1024;
+	unsigned int steps = argc > 2 ? strtoul(argv[2], NULL, 0) : 50;
+
+	die(size < 8 || steps == 0, "Bad arguments");
+
+	main_rng = new_generator();
+
+	printf("%ux%u world, %u steps per run, kernels for cpu level %d\n\n",
+		size, size, steps, cpu_level());
+	print_footprint(size);
+	bench_step_modes(size, steps);
+	bench_orders(size, steps);
+	bench_gene_modes(size, steps);
+	bench_dormancy(size, steps);
+	bench_stripes(size, steps);
+	bench_speculate(size, steps);
+	bench_fused(steps);
+	bench_placement(size);
+
+	free_generator(main_rng);
+	return 0;
+}
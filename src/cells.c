@@ -3,18 +3,20 @@
 *   Copyright (C) 2023 Teresa Maria Rivera
 */
 
+#include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <math.h>
 #include <string.h>
+#include <immintrin.h>
 #include "include/cells.h"
 #include "include/rng.h"
 #include "include/world.h"
 #include "include/math.h"
 #include "include/util.h"
 
-extern generator_handle main_rng;
+extern _Thread_local generator_handle main_rng;
 
 void gen_random_cell(struct cell *c, generator_handle g) 
 {
@@ -29,149 +31,148 @@ void gen_random_cell(struct cell *c, generator_handle g)
 
 	c->updated = false;
 	c->age = 0;
-	c->compass = gen8(g) % 4;
+	c->compass = gen8(g) % 4 + 1; /* compass 0 isn't a direction */
 	c->id = gen64(g);
 	c->energy = 20; /* enough to have one child */
 
 	gen_bytes(g, c->genes, sizeof(gene_t[4]));
 }
 
-uint32_t calc_death_energy(struct cell *c) 
+uint32_t calc_death_energy(uint32_t energy) 
 {
-	if(c->energy < 4)
+	if(energy < 4)
 		return 2;
-	else if(c->energy < 32)
-		return c->energy/2;
+	else if(energy < 32)
+		return energy/2;
 	else
-		return c->energy/4;
+		return energy/4;
 }
 
-#define ONE_IF_ALIVE(w, x, y) ((INDEX_WORLD((*w), x, y).type == 2) ? 1 : 0)
-
-static inline float density(struct world *w, uint32_t x, uint32_t y)
+static inline float density(uint16_t s)
 {
-	/* definitely super inefficient, or super efficient, dunno which */
-	return (ONE_IF_ALIVE(w, x+1, y) + ONE_IF_ALIVE(w, x+1, y+1) + 
-		ONE_IF_ALIVE(w, x, y+1) + ONE_IF_ALIVE(w, x-1, y+1) +
-		ONE_IF_ALIVE(w, x-1, y) + ONE_IF_ALIVE(w, x-1, y-1) +
-		ONE_IF_ALIVE(w, x, y-1) + ONE_IF_ALIVE(w, x+1, y-1) -
-		4.0f) / 8.0f;
+	/* counted 64 tiles at a time off the alive bitplane */
+	return ((float)SENSOR_NBR(s) - 4.0f) / 8.0f;
 }
 
-#undef ONE_IF_ALIVE
-
-static inline uint32_t get_energy(struct tile *t) 
-{
-	if(t->type == 1) {
-		return t->dead.energy;
-	} else {
-		return 0;
-	}
-} 
-
+/* the real index of the tile in front, for anything that writes to it */
 __attribute__((__pure__))
-static inline struct tile *index_forward(struct world *w,
+static inline size_t index_forward(struct world *w,
 	uint32_t x, uint32_t y, int compass)
 {
 	switch(compass) {
 		case NORTH:
-		return &INDEX_WORLD((*w), x, y+1);
+		return INDEX_WORLD((*w), x, WRAP_INC(y, w->height));
 
 		case SOUTH:
-		return &INDEX_WORLD((*w), x, y-1);
+		return INDEX_WORLD((*w), x, WRAP_DEC(y, w->height));
 
 		case EAST:
-		return &INDEX_WORLD((*w), x+1, y);
+		return INDEX_WORLD((*w), WRAP_INC(x, w->length), y);
 
 		case WEST:
-		return &INDEX_WORLD((*w), x - 1, y);
+		return INDEX_WORLD((*w), WRAP_DEC(x, w->length), y);
 
 		default:
-		return index_forward(w, x, y, compass % 5);
+		return index_forward(w, x, y, compass % 4 + 1);
 	}
 }
 
 __attribute__((__pure__))
-static inline struct tile *index_backward(struct world *w,
+static inline size_t index_backward(struct world *w,
 	uint32_t x, uint32_t y, int compass)
 {
 	switch(compass) {
 		case NORTH:
-		return &INDEX_WORLD((*w), x, y-1);
+		return INDEX_WORLD((*w), x, WRAP_DEC(y, w->height));
 
 		case SOUTH:
-		return &INDEX_WORLD((*w), x, y+1);
+		return INDEX_WORLD((*w), x, WRAP_INC(y, w->height));
 
 		case EAST:
-		return &INDEX_WORLD((*w), x-1, y);
+		return INDEX_WORLD((*w), WRAP_DEC(x, w->length), y);
 
 		case WEST:
-		return &INDEX_WORLD((*w), x+1, y);
+		return INDEX_WORLD((*w), WRAP_INC(x, w->length), y);
 
 		default:
-		return index_forward(w, x, y, compass % 5);
+		return index_forward(w, x, y, compass % 4 + 1);
 	}
 }
 
-static inline float input(struct cell *c, struct world *w, 
-	uint32_t x, uint32_t y, gene_t g)
+/* what's around a tile, out of its sensor word */
+#define FOOD_EAST(s)     (((s) & SENSOR_FOOD(EAST)) != 0)
+#define FOOD_WEST(s)     (((s) & SENSOR_FOOD(WEST)) != 0)
+#define FOOD_NORTH(s)    (((s) & SENSOR_FOOD(NORTH)) != 0)
+#define FOOD_SOUTH(s)    (((s) & SENSOR_FOOD(SOUTH)) != 0)
+#define FOOD_FORWARD(s, c)  (((s) & SENSOR_FOOD(c)) != 0)
+#define FOOD_BACKWARD(s, c) (((s) & SENSOR_FOOD(OPPOSITE(c))) != 0)
+
+#define ALIVE_EAST(s)    (((s) & SENSOR_ALIVE(EAST)) != 0)
+#define ALIVE_WEST(s)    (((s) & SENSOR_ALIVE(WEST)) != 0)
+#define ALIVE_NORTH(s)   (((s) & SENSOR_ALIVE(NORTH)) != 0)
+#define ALIVE_SOUTH(s)   (((s) & SENSOR_ALIVE(SOUTH)) != 0)
+#define ALIVE_FORWARD(s, c)  (((s) & SENSOR_ALIVE(c)) != 0)
+#define ALIVE_BACKWARD(s, c) (((s) & SENSOR_ALIVE(OPPOSITE(c))) != 0)
+
+static inline float input(uint32_t c, uint16_t s, struct world *w,
+	uint8_t op)
 {
-	switch((g & GENE_INPUT_BITS) >> 24) {
+	switch(op) {
 		case GENE_AGE:
-		return map_range((float)c->age, 0, 2048, -1.0f, 1.0f);
+		return map_range((float)CELL_AGE(w, c), 0, 2048, -1.0f, 1.0f);
 
 		case GENE_ENERGY:
-		return map_range((float)c->energy, 0, 200, -1.0f, 1.0f);
+		return map_range((float)CELL_ENERGY(w, c), 0, 200, -1.0f, 1.0f);
 
 		case GENE_OSCILATOR:
 		/* no division by zero! */
-		if((c->oscil_ctr/c->oscil_dur & 1) == 0)
+		if((CELL_OSCIL_CTR(w, c)/CELL_OSCIL_DUR(w, c) & 1) == 0)
 			return 1.0;
 		else
 			return -1.0;
 
 		case GENE_FOOD_X:
-		if(INDEX_WORLD((*w), x + 1, y).type == 1) 
+		if(FOOD_EAST(s)) 
 			return 1.0;
-		else if(INDEX_WORLD((*w), x - 1, y).type == 1) 
+		else if(FOOD_WEST(s)) 
 			return -1.0;
 
 		case GENE_FOOD_Y:
-		if(INDEX_WORLD((*w), x, y  + 1).type == 1) 
+		if(FOOD_NORTH(s)) 
 			return 1.0;
-		else if(INDEX_WORLD((*w), x, y - 1).type == 1) 
+		else if(FOOD_SOUTH(s)) 
 			return -1.0;
 		break;
 
 		case GENE_FOOD_FORWARD:
-		return  index_forward(w, x, y, c->compass)->type == 1 ? 1.0 : (
-			index_backward(w, x, y, c->compass)->type == 1? 
+		return  FOOD_FORWARD(s, CELL_COMPASS(w, c)) ? 1.0 : (
+			FOOD_BACKWARD(s, CELL_COMPASS(w, c))? 
 				-1.0 : 
 				0);
 
 		case GENE_OBSTACLE_X:
-		if(INDEX_WORLD((*w), x + 1, y).type == 2) 
+		if(ALIVE_EAST(s)) 
 			return 1.0;
-		else if(INDEX_WORLD((*w), x - 1, y).type == 2) 
+		else if(ALIVE_WEST(s)) 
 			return -1.0;
 
 		case GENE_OBSTACLE_Y:
-		if(INDEX_WORLD((*w), x, y  + 1).type == 2) 
+		if(ALIVE_NORTH(s)) 
 			return 1.0;
-		else if(INDEX_WORLD((*w), x, y - 1).type == 2) 
+		else if(ALIVE_SOUTH(s)) 
 			return -1.0;
 
 		case GENE_OBSTACLE_FORWARD:
-		return  index_forward(w, x, y, c->compass)->type == 2 ? 1.0 : (
-			index_backward(w, x, y, c->compass)->type == 2?
+		return  ALIVE_FORWARD(s, CELL_COMPASS(w, c)) ? 1.0 : (
+			ALIVE_BACKWARD(s, CELL_COMPASS(w, c))?
 				-1.0 : 
 				0);
 
 		case GENE_DENSITY:
-		return density(w, x, y);
+		return density(s);
 
 		case GENE_LAST_X:
-		switch(c->compass) {
+		switch(CELL_COMPASS(w, c)) {
 			case EAST:
 			return 1.0;
 
@@ -185,7 +186,7 @@ static inline float input(struct cell *c, struct world *w,
 		}
 
 		case GENE_LAST_Y:
-		switch(c->compass) {
+		switch(CELL_COMPASS(w, c)) {
 			case NORTH:
 			return 1.0;
 
@@ -204,265 +205,553 @@ static inline float input(struct cell *c, struct world *w,
 	return 0;
 }
 
-static inline int output(struct cell **c, struct world *w,
-	uint32_t *x, uint32_t *y, gene_t g, float in, int *energy)
+/*  Every discrete input at once, SENSE_NEG/ZERO/POS packed two bits per
+*   input at bit 2*input, the same values input() would give (fallthroughs
+*   included) but worked out with selects instead of a switch. Inputs that
+*   aren't discrete are left at zero, compiled genes never look at them.
+*/
+#define SENSE_AT(op, v) ((uint32_t)(v) << 2 * (op))
+#define TERNARY(pos, neg) ((pos) ? SENSE_POS : (neg) ? SENSE_NEG : SENSE_ZERO)
+
+static inline uint32_t sense(uint32_t c, uint16_t s, struct world *w)
 {
-	unsigned int tmp;
-	struct tile *victim;
-
-	switch(g & GENE_OUTPUT_BITS) {
-		case GENE_MOVE_X:
-gene_move_x:
-		if(in > 1.0) {
-			if(INDEX_WORLD((*w), *x + 1, *y).type == 1)
-				(*c)->energy += INDEX_WORLD((*w), *x + 1, *y)
-					.dead.energy;
-			else if(INDEX_WORLD((*w), *x - 1, *y).type == 0)
-				return 0;
-
-			memcpy(
-				&INDEX_WORLD((*w), *x + 1, *y),
-				&INDEX_WORLD((*w), *x, *y), 
-				sizeof(struct tile)
-			);
-			INDEX_WORLD((*w), *x, *y).type = 0;
-			*c = &INDEX_WORLD((*w), ++(*x), *y).cell;
-			(*c)->compass = EAST;
-			break;
-		} else if(in < -1.0) {
-			if(INDEX_WORLD((*w), *x - 1, *y).type == 1)
-				(*c)->energy += INDEX_WORLD((*w), *x - 1, *y)
-					.dead.energy;
-			else if(INDEX_WORLD((*w), *x - 1, *y).type == 0)
-				return 0;
-
-			memcpy(
-				&INDEX_WORLD((*w), *x - 1, *y),
-				&INDEX_WORLD((*w), *x, *y), 
-				sizeof(struct tile)
-			);
-			INDEX_WORLD((*w), *x, *y).type = 0;
-			*c = &INDEX_WORLD((*w), --(*x), *y).cell;
-			(*c)->compass = WEST;
-			break;
-		}
-		return 0;
+	int compass = CELL_COMPASS(w, c);
+	uint32_t food_y, food_x, food_fwd, obst_fwd, obst_y, obst_x, osc;
+	bool fe = FOOD_EAST(s), fw = FOOD_WEST(s);
+	bool ae = ALIVE_EAST(s), aw = ALIVE_WEST(s);
+	bool an = ALIVE_NORTH(s), as = ALIVE_SOUTH(s);
+
+	food_y   = TERNARY(FOOD_NORTH(s), FOOD_SOUTH(s));
+	food_x   = (fe | fw) ? TERNARY(fe, fw) : food_y;
+	food_fwd = TERNARY(FOOD_FORWARD(s, compass),
+		FOOD_BACKWARD(s, compass));
+
+	obst_fwd = TERNARY(ALIVE_FORWARD(s, compass),
+		ALIVE_BACKWARD(s, compass));
+	obst_y   = (an | as) ? TERNARY(an, as) : obst_fwd;
+	obst_x   = (ae | aw) ? TERNARY(ae, aw) : obst_y;
+
+	osc = (CELL_OSCIL_CTR(w, c)/CELL_OSCIL_DUR(w, c) & 1) == 0 ?
+		SENSE_POS : SENSE_NEG;
+
+	return SENSE_AT(0, SENSE_ZERO) |
+		SENSE_AT(GENE_OBSTACLE_X, obst_x) |
+		SENSE_AT(GENE_OBSTACLE_Y, obst_y) |
+		SENSE_AT(GENE_OBSTACLE_FORWARD, obst_fwd) |
+		SENSE_AT(GENE_FOOD_X, food_x) |
+		SENSE_AT(GENE_FOOD_Y, food_y) |
+		SENSE_AT(GENE_FOOD_FORWARD, food_fwd) |
+		SENSE_AT(GENE_LAST_X,
+			TERNARY(compass == EAST, compass == WEST)) |
+		SENSE_AT(GENE_LAST_Y,
+			TERNARY(compass == NORTH, compass == SOUTH)) |
+		SENSE_AT(GENE_OSCILATOR, osc);
+}
 
-		case GENE_MOVE_Y:
-gene_move_y:
-		if(in > 1.0) {
-			if(INDEX_WORLD((*w), *x, *y + 1).type == 1)
-				(*c)->energy += INDEX_WORLD((*w), *x, *y + 1)
-					.dead.energy;
-			else if(INDEX_WORLD((*w), *x, *y + 1).type == 0)
-				return 0;
-
-			memcpy(
-				&INDEX_WORLD((*w), *x, *y + 1),
-				&INDEX_WORLD((*w), *x, *y), 
-				sizeof(struct tile)
-			);
-			INDEX_WORLD((*w), *x, *y).type = 0;
-			*c = &INDEX_WORLD((*w), *x, ++(*y)).cell;
-			(*c)->compass = NORTH;
-			break;
-		} else if(in < -1.0) {
-			switch(INDEX_WORLD((*w), *x, *y  - 1).type) {
-				case 1:
-				(*c)->energy += INDEX_WORLD((*w), *x, *y - 1)
-					.dead.energy;
-				case 0:
-				break;
-
-				default:
-				return 0;
-			}
+#undef TERNARY
 
-			memcpy(
-				&INDEX_WORLD((*w), *x - 1, *y),
-				&INDEX_WORLD((*w), *x, *y), 
-				sizeof(struct tile)
-			);
-			INDEX_WORLD((*w), *x, *y).type = 0;
-			*c = &INDEX_WORLD((*w), *x, --(*y)).cell;
-			(*c)->compass = SOUTH;
-			break;
-		}
-		return 0;
+/* input() in Q16.16, the discrete ones straight out of the packed sensors */
+static inline int64_t input_fixed(uint32_t c, uint16_t sw, uint32_t s,
+	struct world *w, uint8_t op)
+{
+	switch(op) {
+		case GENE_AGE:
+		return map_range_fixed(CELL_AGE(w, c), 0, 2048,
+			-FIXED_ONE, FIXED_ONE);
 
-		case GENE_COMMIT_SUICIDE:
-		if(fabsf(in) > 3.5f) {
-			/* suicide is indicated with a -1 returned,
-			*  a null *c, and a 1 in INDEX((*w), *x, *y).type 
-			*/
-			INDEX_WORLD((*w), *x, *y).type = 1;
-			INDEX_WORLD((*w), *x, *y)
-				.dead.energy = calc_death_energy((*c));
-			*c = NULL;
-			return -1;
+		case GENE_ENERGY:
+		return map_range_fixed(CELL_ENERGY(w, c), 0, 200,
+			-FIXED_ONE, FIXED_ONE);
+
+		case GENE_DENSITY:
+		return ((int64_t)SENSOR_NBR(sw) - 4) * FIXED_ONE / 8;
+
+		default:
+		return ((int64_t)((s >> 2 * op) & 3) - 1) * FIXED_ONE;
+	}
+}
+
+/* the input of a gene, discrete ones straight out of the packed sensors */
+static inline float lane_input(uint32_t c, uint16_t sw, uint32_t s,
+	struct world *w, uint8_t op)
+{
+	switch(op) {
+		case GENE_AGE:
+		case GENE_ENERGY:
+		case GENE_DENSITY:
+		return input(c, sw, w, op);
+
+		default:
+		return (float)((int)((s >> 2 * op) & 3) - 1);
+	}
+}
+
+/*  All four genes of a cell at once: the inputs go in one vector, get
+*   scaled by the genome's strengths, clamped with a single min/max, and
+*   held against its thresholds. What each lane wants to do ends up in a
+*   few masks, step_cell still carries them out in order.
+*/
+static inline void decide_lanes(uint32_t c, uint16_t sw, uint32_t s,
+	struct world *w, struct gene_action out[4])
+{
+	const struct gene_lanes *l = &CELL_LANES(w, c);
+	const struct gene_prog *p = CELL_PROG(w, c);
+	_Alignas(16) int32_t osc[4];
+	int hi, lo, fire = 0, neg = 0;
+	__m128 in;
+
+	in = _mm_setr_ps(lane_input(c, sw, s, w, p[0].input),
+		lane_input(c, sw, s, w, p[1].input),
+		lane_input(c, sw, s, w, p[2].input),
+		lane_input(c, sw, s, w, p[3].input));
+	in = _mm_mul_ps(in, _mm_load_ps(l->strength));
+
+	/* maxps hands back the second operand for a nan, just like fmaxf */
+	in = _mm_min_ps(_mm_max_ps(in, _mm_set1_ps(-4.0f)),
+		_mm_set1_ps(4.0f));
+
+	hi = _mm_movemask_ps(_mm_cmpgt_ps(in, _mm_load_ps(l->hi)));
+	lo = _mm_movemask_ps(_mm_cmplt_ps(in, _mm_load_ps(l->lo)));
+
+	if(l->osc) {
+		/* the oscillator's sanitization, |in| >= 0.1 or |in*100| == 1 */
+		__m128i tmp = _mm_cvttps_epi32(
+			_mm_mul_ps(in, _mm_set1_ps(100.0f)));
+		__m128i sign = _mm_srai_epi32(tmp, 31);
+
+		tmp = _mm_sub_epi32(_mm_xor_si128(tmp, sign), sign); /* abs */
+
+		_mm_store_si128((__m128i *)osc, tmp);
+		fire = _mm_movemask_ps(_mm_or_ps(
+			_mm_or_ps(_mm_cmpge_ps(in, _mm_set1_ps(0.1f)),
+				_mm_cmple_ps(in, _mm_set1_ps(-0.1f))),
+			_mm_castsi128_ps(_mm_cmpeq_epi32(tmp,
+				_mm_set1_epi32(1)))));
+		neg = _mm_movemask_ps(_mm_cmplt_ps(in, _mm_setzero_ps()));
+	}
+
+	for(int i = 0; i < 4; i++) {
+		out[i] = (struct gene_action){ ACT_NONE, 0 };
+
+		if(l->osc >> i & 1) {
+			if(fire >> i & 1)
+				out[i] = (struct gene_action){
+					neg >> i & 1 ? ACT_OSC_NEG : ACT_OSC_POS,
+					osc[i]
+				};
+		} else if(hi >> i & 1) {
+			out[i].op = l->on_hi[i];
+		} else if(lo >> i & 1) {
+			out[i].op = l->on_lo[i];
 		}
-		return 0;
+	}
+}
 
-		case GENE_MOVE_FORWARD:
-		/* I am not gonna lie, i'm only using gotos cause im lazy */
-		switch((*c)->compass) {
-			case SOUTH:
-			in *= -1;
-			case NORTH:
-			goto gene_move_y;
+/*  One handler for every (input, output) pair a sanitized gene can have.
+*   Both opcodes are constants in each, so input_fixed and
+*   decide_action_fixed fold down to their one case and whatever's left is
+*   a few compares. They come out exactly like GENES_FIXED, and every pair
+*   shows up in a profile under its own name.
+*/
+#define HANDLER(in, out)                                                  \
+static struct gene_action handle_##in##_##out(struct world *w,           \
+	uint32_t c, uint16_t sw, uint32_t s, fixed_t strength)           \
+{                                                                        \
+	return decide_action_fixed(out,                                  \
+		scale_fixed(input_fixed(c, sw, s, w, in), strength));    \
+}
 
-			case WEST:
-			in *= -1;
-			case EAST:
-			goto gene_move_x;
+#define HANDLERS(in) HANDLER(in, 0) HANDLER(in, 1) HANDLER(in, 2) \
+	HANDLER(in, 3) HANDLER(in, 4) HANDLER(in, 5) HANDLER(in, 6)
 
-			default:
+HANDLERS(0)  HANDLERS(1)  HANDLERS(2)  HANDLERS(3)  HANDLERS(4)
+HANDLERS(5)  HANDLERS(6)  HANDLERS(7)  HANDLERS(8)  HANDLERS(9)
+HANDLERS(10) HANDLERS(11) HANDLERS(12)
+
+#define HANDLER_ROW(in) { handle_##in##_0, handle_##in##_1, \
+	handle_##in##_2, handle_##in##_3, handle_##in##_4, \
+	handle_##in##_5, handle_##in##_6 }
+
+/* by input, then output, the same 13 and 7 as SANITIZE_GENE */
+static const gene_handler handlers[13][7] = {
+	HANDLER_ROW(0),  HANDLER_ROW(1),  HANDLER_ROW(2),  HANDLER_ROW(3),
+	HANDLER_ROW(4),  HANDLER_ROW(5),  HANDLER_ROW(6),  HANDLER_ROW(7),
+	HANDLER_ROW(8),  HANDLER_ROW(9),  HANDLER_ROW(10), HANDLER_ROW(11),
+	HANDLER_ROW(12)
+};
+
+#undef HANDLER_ROW
+#undef HANDLERS
+#undef HANDLER
+
+void pick_handlers(const struct gene_prog prog[4], gene_handler handler[4])
+{
+	for(int i = 0; i < 4; i++)
+		handler[i] = handlers[prog[i].input][prog[i].output];
+}
+
+/* what's needed to run a cell's genes, off the sensor word of its tile */
+static inline void read_sensors(struct world *w, uint32_t c, size_t t,
+	uint16_t *sw, uint32_t *s, struct gene_action lanes[4])
+{
+	*sw = world_sensors(w, t);
+	*s = w->gene_mode != GENES_DECODED ? sense(c, *sw, w) : 0;
+	if(w->gene_mode == GENES_VECTOR)
+		decide_lanes(c, *sw, *s, w, lanes);
+}
+
+/* what gene i wants to do, however genes are being run */
+static inline struct gene_action decide_gene(struct world *w, uint32_t c,
+	int i, uint16_t sw, uint32_t s, const struct gene_action lanes[4])
+{
+	struct gene_action a = { ACT_SENSE, 0 };
+
+	if(w->gene_mode == GENES_FIXED) {
+		const struct gene_prog *p = &CELL_PROG(w, c)[i];
+
+		a = CELL_ACT_FIXED(w, c)[i][(s >> 2 * p->input) & 3];
+		if(a.op == ACT_SENSE)
+			a = decide_action_fixed(p->output, scale_fixed(
+				input_fixed(c, sw, s, w, p->input),
+				p->fixed));
+	} else if(w->gene_mode == GENES_TABLE) {
+		a = CELL_HANDLER(w, c)[i](w, c, sw, s, CELL_PROG(w, c)[i].fixed);
+	} else if(w->gene_mode == GENES_VECTOR) {
+		a = lanes[i];
+	} else if(w->gene_mode == GENES_COMPILED) {
+		a = CELL_ACT(w, c)[i][(s >> 2 * CELL_PROG(w, c)[i].input) & 3];
+	}
+
+	if(a.op == ACT_SENSE) {
+		struct gene_prog p = CELL_PROG(w, c)[i];
+		float gene_input = 0;
+
+		/* propagate the input, the strength was worked out at birth */
+		gene_input = input(c, sw, w, p.input) * p.strength;
+		gene_input = fminf(fmaxf(gene_input, -4.0), 4.0);
+		a = decide_action(p.output, gene_input);
+	}
+
+	return a;
+}
+
+/* *c is set to this once the cell stops existing */
+#define NO_CELL UINT32_MAX
+
+/* moves the cell at *x, *y to nx, ny, eating anything dead in the way,
+*  returns false if another cell is in the way
+*/
+static inline bool move_cell(uint32_t c, size_t *t, struct world *w,
+	uint32_t *x, uint32_t *y, uint32_t nx, uint32_t ny, int compass)
+{
+	size_t dst = INDEX_WORLD((*w), nx, ny);
+
+	switch(TILE_TYPE(w, dst)) {
+		case 1:
+		cell_gain(w, c, TILE_ENERGY(w, dst));
+		case 0:
+		break;
+
+		default:
+		return false;
+	}
+
+	world_move_cell(w, dst, *t);
+	*t = dst;
+	*x = nx;
+	*y = ny;
+	CELL_COMPASS(w, c) = compass;
+	return true;
+}
+
+/* one tile towards a compass point, same deal as move_cell */
+static inline bool move_towards(uint32_t c, size_t *t, struct world *w,
+	uint32_t *x, uint32_t *y, int compass)
+{
+	switch(compass) {
+		case NORTH:
+		return move_cell(c, t, w, x, y,
+			*x, WRAP_INC(*y, w->height), NORTH);
+
+		case SOUTH:
+		return move_cell(c, t, w, x, y,
+			*x, WRAP_DEC(*y, w->height), SOUTH);
+
+		case EAST:
+		return move_cell(c, t, w, x, y,
+			WRAP_INC(*x, w->length), *y, EAST);
+
+		case WEST:
+		return move_cell(c, t, w, x, y,
+			WRAP_DEC(*x, w->length), *y, WEST);
+
+		default:
+		return false;
+	}
+}
+
+/* does what decide_action worked out the gene wants */
+static inline int output(uint32_t *c, size_t *t, struct world *w,
+	uint32_t *x, uint32_t *y, struct gene_action a, int *energy)
+{
+	unsigned int tmp;
+	size_t victim;
+	uint32_t vc;
+
+	switch(a.op) {
+		case ACT_MOVE_NORTH:
+		case ACT_MOVE_SOUTH:
+		case ACT_MOVE_WEST:
+		case ACT_MOVE_EAST:
+		if(!move_towards(*c, t, w, x, y, a.op))
 			return 0;
-		}
+		break;
 
-		case GENE_SET_OSCILATOR:
-		tmp = abs((int)(in * 100));
+		case ACT_MOVE_FORWARD:
+		if(!move_towards(*c, t, w, x, y, CELL_COMPASS(w, *c)))
+			return 0;
+		break;
 
-		/* some weird sanitization */
-		if(in < 0.1 && in > -0.1 && tmp != 1)
+		case ACT_MOVE_BACKWARD:
+		if(!move_towards(*c, t, w, x, y,
+			OPPOSITE(CELL_COMPASS(w, *c))))
 			return 0;
+		break;
+
+		case ACT_SUICIDE:
+		/* suicide is indicated with a -1 returned,
+		*  a NO_CELL *c, and a 1 in the type plane
+		*/
+		world_kill_cell(w, *t);
+		*c = NO_CELL;
+		return -1;
 
+		case ACT_OSC_POS:
+		case ACT_OSC_NEG:
 		/* no division by zero! */
-		if(((*c)->oscil_ctr/(*c)->oscil_dur & 1) == 0) {
-			if(in < 0) {
-				(*c)->oscil_ctr = tmp;
+		if((CELL_OSCIL_CTR(w, *c)/CELL_OSCIL_DUR(w, *c) & 1) == 0) {
+			if(a.op == ACT_OSC_NEG) {
+				CELL_OSCIL_CTR(w, *c) = a.osc;
 			} else {
-				(*c)->oscil_ctr = 1;
+				CELL_OSCIL_CTR(w, *c) = 1;
 			}
 		} else {
-			if(in < 0) {
-				(*c)->oscil_ctr = 1;
+			if(a.op == ACT_OSC_NEG) {
+				CELL_OSCIL_CTR(w, *c) = 1;
 			} else {
-				(*c)->oscil_ctr = tmp;
+				CELL_OSCIL_CTR(w, *c) = a.osc;
 			}
 		}
 
-		(*c)->oscil_dur = tmp;
+		CELL_OSCIL_DUR(w, *c) = a.osc;
 		break;
 
-		case GENE_KILL_FORWARD:
-		if(in < -2)
-			victim = index_backward(w, *x, *y, (*c)->compass);
-		else if(in > 2)
-			victim = index_forward(w, *x, *y, (*c)->compass);
+		case ACT_KILL_FORWARD:
+		case ACT_KILL_BACKWARD:
+		if(a.op == ACT_KILL_BACKWARD)
+			victim = index_backward(w, *x, *y, CELL_COMPASS(w, *c));
 		else
-			return 0;
+			victim = index_forward(w, *x, *y, CELL_COMPASS(w, *c));
 
-		if(victim->type == 1) {
-			(*c)->energy += victim->dead.energy;
+		if(TILE_TYPE(w, victim) == 1) {
+			cell_gain(w, *c, TILE_ENERGY(w, victim));
+			world_remove_dead(w, victim);
 			break;
-		} else if(victim->type == 0)
+		} else if(TILE_TYPE(w, victim) == 0)
 			return 0;
-		
+
+		vc = TILE_HANDLE(w, victim);
+		if(unlikely(this_worker != NULL))
+			world_save_cell(w, vc);
+		if(CELL_ACTIONS(w, vc) & CELL_DORMANT)
+			world_wake_cell(w, vc);
+
 		/* subtract the energy from the kill, but record the old energy
 		*  that way we can subtract energy from them if they win
 		*/
-		tmp = (*c)->energy;
-		(*c)->energy -= 2 + ((victim->cell.energy <= 2)?
+		tmp = CELL_ENERGY(w, *c);
+		cell_lose(w, *c, (2 +
+			((CELL_ENERGY(w, vc) <= 2)?
 			-2 :
-			victim->cell.energy-calc_death_energy(&victim->cell));
+			CELL_ENERGY(w, vc) -
+				calc_death_energy(CELL_ENERGY(w, vc)))));
 
-		if((*c)->energy == 0) {
+		if(CELL_ENERGY(w, *c) == 0) {
 			/* they beat us in a fight, die with honor
 			*  but treat it like they killed us...
 			*  except that we don't reroll if they died
 			*/
 
-			(*c)->energy = tmp;
-			victim->cell.energy -= 2 + tmp - calc_death_energy(*c);
+			cell_set_energy(w, *c, tmp);
+			cell_lose(w, vc, 2 + tmp - calc_death_energy(tmp));
 
-			INDEX_WORLD((*w), *x, *y).type = 1;
-			INDEX_WORLD((*w), *x, *y)
-				.dead.energy = calc_death_energy((*c));
-			*c = NULL;
+			world_kill_cell(w, *t);
+			*c = NO_CELL;
 			return 0x6c6f7373; /* loss in ascii in hex */
 		}
 
 		/* we beat them, now we reap the rewards */
-		victim->type = 0;
-		(*c)->energy += calc_death_energy(&victim->cell);
+		cell_gain(w, *c, calc_death_energy(CELL_ENERGY(w, vc)));
+		world_remove_cell(w, victim);
 		return 0x6b696c6c; /* kill in ascii in hex */
 
 		default:
 		return 0;
 	}
 	(*energy)++;
+	return 0;
 }
 
-void step_cell(struct tile *t, struct world *w, struct statistics *stats, 
-	uint32_t x, uint32_t y)
+bool conceive_child(struct world *w, uint32_t c, size_t n,
+	struct cell *child, gene_t parent[4])
 {
-	struct cell *c;
-	stats->food = t->type == 1 ? 1 : 0 ;
-	if(t->type != 2 || t->cell.updated)
+	uint64_t dice = cell_dice(w, c, w->iters, DICE_CHILD);
+
+	if(TILE_TYPE(w, n) == 1) {
+		cell_gain(w, c, TILE_ENERGY(w, n));
+		world_remove_dead(w, n);
+	}
+
+	child->energy = CELL_ENERGY(w, c)/4;
+	cell_set_energy(w, c, CELL_ENERGY(w, c)/2);
+
+	child->id = mix64_next(&dice);
+	child->age = 0;
+	child->oscil_ctr = CELL_OSCIL_CTR(w, c);
+	child->oscil_dur = CELL_OSCIL_DUR(w, c);
+	child->compass = CELL_COMPASS(w, c);
+
+	/*  a raster walk that gets to the child still steps it, like it always
+	*   did. Going through the pool, whether it got a turn would be down to
+	*   which slot it got, so there it waits for the next step.
+	*/
+	if(w->step_mode == STEP_DENSE || w->step_mode == STEP_SPECULATE)
+		child->updated = !w->parity;
+	else
+		child->updated = w->parity;
+
+	/* genomes are shared, mutate a copy */
+	memcpy(parent, CELL_GENES(w, c), sizeof(gene_t[4]));
+	return duplicate_genes(parent, child->genes, dice);
+}
+
+void deliver_child(struct world *w, struct statistics *stats, uint32_t c,
+	size_t n, const struct cell *child, const gene_t parent[4],
+	bool mutated)
+{
+	/* the parent's mutated too, it gets its own genome */
+	if(mutated) {
+		uint32_t g = world_intern_genome(w, parent);
+		world_drop_genome(w, CELL_GENOME(w, c));
+		CELL_GENOME(w, c) = g;
+	}
+	world_store_cell(w, n, child);
+	if(unlikely(this_worker != NULL) && this_worker->journal)
+		slice_born(w, this_worker->slice, n);
+	stats->births++;
+}
+
+void give_birth(struct world *w, struct statistics *stats,
+	uint32_t c, size_t n)
+{
+	struct cell child;
+	gene_t parent[4];
+	bool mutated;
+
+	/* nowhere to put the child, try again some other time */
+	if(TILE_TYPE(w, n) == 2)
 		return;
 
-	c = &t->cell;
+	/* out of slots next to other threads, the stripe gets redone alone */
+	if(unlikely(!worker_has_slot(this_worker))) {
+		this_worker->broken = true;
+		return;
+	}
 
-	if(
-		c->energy == 0 || /* starvation */
-		c->age == 2048 || /* and old age */
-		(c->age >= 1116 && unlikely(gen32(main_rng) == 0x64696521))
-	) {
-		stats->death++;
-		if(c->energy == 0)
-			stats->starve++;
-		else
-		 	stats->old_age++;
-		stats->food++;
+	mutated = conceive_child(w, c, n, &child, parent);
+	deliver_child(w, stats, c, n, &child, parent, mutated);
+}
+
+void step_cell(struct world *w, struct statistics *stats, 
+	uint32_t x, uint32_t y)
+{
+	size_t t = INDEX_WORLD((*w), x, y);
+	uint32_t c, s = 0;
+	uint16_t sw = 0;
+	int actions = 0;
+	bool sensed = false, woke = false;
+	struct gene_action lanes[4];
+	struct worker *k = this_worker;
+	bool journal = unlikely(k != NULL) && k->journal;
+	if(TILE_TYPE(w, t) != 2)
+		return;
 
-		/* commit die */
-		t->type = 1;
-		t->dead.energy = calc_death_energy(c);
+	c = TILE_HANDLE(w, t);
+
+	/*  parked until its deadline, then it rolls the dice that woke it
+	*   like any other cell, its updated flag is stale, parked cells never
+	*   move anyway
+	*/
+	if(CELL_ACTIONS(w, c) & CELL_DORMANT) {
+		if(cell_asleep(w, c))
+			return;
+	} else if(CELL_UPDATED(w, c) == w->parity) {
 		return;
 	}
-	stats->pop++;
 
-	/* birth. ser in ascii, Spanish for "to be" */
-	if(c->energy >= 8 && unlikely((gen32(main_rng) & 0x00ffffff) == 0x736572)) {
-		struct tile *n;
+	/* a stripe's run that might be redone, see speculate.c */
+	if(journal) {
+		world_save_cell(w, c);
+		slice_mark(w, k->slice, t);
+	}
+
+	if(CELL_ACTIONS(w, c) & CELL_DORMANT) {
+		world_wake_cell(w, c);
+		woke = true;
+	}
+
+	/*  birth. Threads stepping stripes have a few slots of their own, when
+	*   they run out they pay for the child right away and have it once
+	*   they're done, unless they're speculating, then it's a redo.
+	*/
+	if(CELL_ENERGY(w, c) >= 8 && unlikely(birth_roll(w, c, w->iters))) {
+		size_t n = index_forward(w, x, y, CELL_COMPASS(w, c));
 
-		do {
-			n = index_forward(w, x, y, c->compass);
-		} while(n->type == 2);
-		if(n->type == 1)
-			c->energy += n->dead.energy;
+		if(k != NULL && k->slice == NULL && !worker_has_slot(k))
+			worker_defer_birth(w, k, c, n);
+		else
+			give_birth(w, stats, c, n);
+	}
 
-		n->cell.energy = c->energy/4;
-		c->energy /= 2;
-		
-		n->cell.id = gen64(main_rng);
-		n->cell.age = 0;
-		n->cell.oscil_ctr = c->oscil_ctr;
-		n->cell.oscil_dur = c->oscil_dur;
-		duplicate_genes(c->genes, n->cell.genes);
+	/*  nothing any of the genes could do, may as well sleep through it,
+	*   unless it just woke up, then it has a metabolism to go through
+	*/
+	if(CELL_INERT(w, c)) {
+		CELL_UPDATED(w, c) = w->parity;
+		if(w->dormancy && !woke)
+			world_park_cell(w, c);
+		return;
 	}
 
 	for(int i = 0; i < 4; i++) {
-		float gene_input = 0;
-		int actions;
+		struct gene_action a;
 		int tmp;
-		c->genes[i] = SANITIZE_GENE(c->genes[i]);
-		
-		/* propagate the input */
-		gene_input = input(c, w, x, y, c->genes[i]);
-		
-		/* do some weird math to make a strength that is limited
-		*  but not flat, ie changes after hitting 4. Makes things more
-		* interesting
+
+		/*  the sensors only need reading again after the cell did
+		*   something, compiled genes then just look up what they do
 		*/
-		gene_input *= 4 * sinf(0.25 * strength_to_float(
-			(uint16_t)((c->genes[i] & GENE_STRENGTH_BITS) >> 8)
-		));
-		gene_input = fminf(fmaxf(gene_input, -4.0), 4.0);
+		if(!sensed) {
+			read_sensors(w, c, t, &sw, &s, lanes);
+			sensed = true;
+		}
+
+		a = decide_gene(w, c, i, sw, s, lanes);
+		if(a.op == ACT_NONE)
+			continue;
 
-		tmp = output(&c, w, &x, &y, c->genes[i], gene_input, &actions);
-		if(c == NULL) {
+		sensed = false;
+		tmp = output(&c, &t, w, &x, &y, a, &actions);
+		if(c == NO_CELL) {
 			if(tmp == -1)
 				stats->suicide++;
 			else
@@ -472,7 +761,342 @@ void step_cell(struct tile *t, struct world *w, struct statistics *stats,
 
 		if(tmp == 0x6b696c6c)
 			stats->murder++;
+
+		if(journal)
+			slice_mark(w, k->slice, t);
 	}
 
-	c->updated = true;
-}
\ No newline at end of file
+	CELL_ACTIONS(w, c) = actions;
+	CELL_UPDATED(w, c) = w->parity;
+}
+
+/*  What a cell wants to do this step under STEP_INTENT. Every gene reads
+*   the same sensors, the ones from the start of the step. Oscillator
+*   changes only touch the cell itself so all of them are kept, but a cell
+*   gets one thing done to the tiles around it at most (a move, a kill or
+*   suicide), the first one of its genes asked for that could have gone
+*   through with the world as it was.
+*/
+struct intent {
+	uint32_t cell;    /* NO_CELL once it's dead */
+	uint32_t target;  /* the tile act is aimed at */
+	uint32_t nursery; /* where the child goes, NOWHERE for no child */
+	struct gene_action act;
+	struct gene_action osc[4];
+	uint8_t n_osc;
+	uint8_t actions;
+	bool woke; /* was parked and due, woken up in commit_intents */
+};
+
+/* kills are carried out in order of these */
+struct intent_key {
+	uint64_t priority;
+	uint32_t cell;
+	uint32_t intent;
+};
+
+#define NOWHERE  UINT32_MAX
+#define NO_CLAIM UINT32_MAX
+
+/*  Who goes first when two cells want the same thing. It's the cell's id
+*   hashed with the step, so nobody wins every time just for being early in
+*   the pool or the raster, and the handle breaks the (unlikely) ties.
+*/
+static inline uint64_t priority(struct world *w, uint32_t c)
+{
+	return mix64((uint64_t)CELL_ID(w, c) ^ (uint64_t)w->iters << 32);
+}
+
+static inline bool goes_first(struct world *w, uint32_t a, uint32_t b)
+{
+	uint64_t pa = priority(w, a), pb = priority(w, b);
+
+	return pa < pb || (pa == pb && a < b);
+}
+
+static int key_order(const void *a, const void *b)
+{
+	const struct intent_key *x = a, *y = b;
+
+	if(x->priority != y->priority)
+		return x->priority < y->priority ? -1 : 1;
+	return (x->cell > y->cell) - (x->cell < y->cell);
+}
+
+static inline bool is_move(int op)
+{
+	return op >= ACT_MOVE_NORTH && op <= ACT_MOVE_BACKWARD;
+}
+
+/* the tile an action is aimed at, a cell's own for suicide */
+static inline size_t aim(struct world *w, uint32_t c,
+	uint32_t x, uint32_t y, int op)
+{
+	switch(op) {
+		case ACT_MOVE_FORWARD:
+		case ACT_KILL_FORWARD:
+		return index_forward(w, x, y, CELL_COMPASS(w, c));
+
+		case ACT_MOVE_BACKWARD:
+		case ACT_KILL_BACKWARD:
+		return index_backward(w, x, y, CELL_COMPASS(w, c));
+
+		case ACT_SUICIDE:
+		return INDEX_WORLD((*w), x, y);
+
+		default:
+		return index_forward(w, x, y, op); /* moves match the compass */
+	}
+}
+
+/* step_cell up to the genes, only noting down what it would do */
+static void intend_cell(struct world *w, struct intent *in, size_t t)
+{
+	uint32_t c = in->cell, s, y = world_row(w, t) - 1;
+	uint32_t x = t - (y + 1) * w->stride - 1;
+	uint16_t sw;
+	struct gene_action lanes[4];
+
+	if(CELL_ENERGY(w, c) >= 8 && unlikely(birth_roll(w, c, w->iters))) {
+		size_t n = index_forward(w, x, y, CELL_COMPASS(w, c));
+
+		if(TILE_TYPE(w, n) != 2)
+			in->nursery = n;
+	}
+
+	if(CELL_INERT(w, c))
+		return;
+
+	read_sensors(w, c, t, &sw, &s, lanes);
+	for(int i = 0; i < 4; i++) {
+		struct gene_action a = decide_gene(w, c, i, sw, s, lanes);
+		size_t to;
+		bool ok;
+
+		if(a.op == ACT_NONE)
+			continue;
+
+		if(a.op == ACT_OSC_POS || a.op == ACT_OSC_NEG) {
+			in->osc[in->n_osc++] = a;
+			continue;
+		}
+
+		if(in->act.op != ACT_NONE)
+			continue;
+
+		/*  moves need somewhere without a cell that the child isn't
+		*   going to, kills need something to kill
+		*/
+		to = aim(w, c, x, y, a.op);
+		if(a.op == ACT_SUICIDE)
+			ok = true;
+		else if(is_move(a.op))
+			ok = TILE_TYPE(w, to) != 2 && to != in->nursery;
+		else
+			ok = TILE_TYPE(w, to) != 0;
+
+		if(ok) {
+			in->act = a;
+			in->target = to;
+		}
+	}
+}
+
+uint32_t intend_cells(struct world *w)
+{
+	struct cell_pool *p = &w->pool;
+	uint32_t n = 0;
+
+	if(unlikely(w->intents_capacity < p->top)) {
+		w->intents_capacity = p->capacity;
+		w->intents = realloc(w->intents,
+			w->intents_capacity * sizeof(*w->intents));
+		w->intent_order = realloc(w->intent_order,
+			w->intents_capacity * sizeof(*w->intent_order));
+		die(w->intents == NULL || w->intent_order == NULL,
+			"Couldn't grow the intents");
+	}
+
+	if(unlikely(w->claims == NULL)) {
+		size_t area = (size_t)w->stride * (w->height + 2);
+
+		w->claims = malloc(area * sizeof(*w->claims));
+		die(w->claims == NULL, "Couldn't allocate the claims");
+		memset(w->claims, 0xff, area * sizeof(*w->claims));
+	}
+
+	/*  past this, reading the sensors doesn't write anything, only the
+	*   words with real tiles in them ever get read
+	*/
+	for(size_t k = (w->stride + 1) >> 6;
+		k <= ((size_t)w->stride * (w->height + 1) - 2) >> 6; k++)
+		if(w->sensors_stale[k])
+			world_count_sensors(w, k);
+
+	for(uint32_t h = 0; h < p->top; h++) {
+		uint32_t t = CELL_TILE(w, h);
+		struct intent *in;
+
+		if((t & POOL_FREE) || cell_asleep(w, h))
+			continue;
+
+		in = &w->intents[n++];
+		*in = (struct intent){
+			.cell = h,
+			.target = NOWHERE,
+			.nursery = NOWHERE,
+			.act = { ACT_NONE, 0 },
+		};
+
+		/* waking it up writes to it, that's left for later */
+		if(CELL_ACTIONS(w, h) & CELL_DORMANT)
+			in->woke = true;
+		else
+			intend_cell(w, in, t);
+	}
+
+	return n;
+}
+
+/* output() for one of the things a cell intended, from where it is now */
+static inline int carry_out(struct world *w, struct intent *in,
+	struct gene_action a)
+{
+	size_t t = CELL_TILE(w, in->cell);
+	uint32_t y = world_row(w, t) - 1;
+	uint32_t x = t - (y + 1) * w->stride - 1;
+	int actions = in->actions, ret;
+
+	ret = output(&in->cell, &t, w, &x, &y, a, &actions);
+	in->actions = actions;
+	return ret;
+}
+
+/* the same bookkeeping step_cell does after output() */
+static inline void count_outcome(struct statistics *stats,
+	struct intent *in, int ret)
+{
+	if(in->cell == NO_CELL) {
+		if(ret == -1)
+			stats->suicide++;
+		else
+			stats->murder++;
+	} else if(ret == 0x6b696c6c) {
+		stats->murder++;
+	}
+}
+
+static inline void stake(struct world *w, uint32_t claim, size_t t)
+{
+	uint32_t *old = &w->claims[t];
+
+	if(*old == NO_CLAIM || goes_first(w, w->intents[claim >> 1].cell,
+		w->intents[*old >> 1].cell))
+		*old = claim;
+}
+
+/*  Everything goes in rounds, each one against the world the last one
+*   left behind. Cells that were due wake up (and may want a child), then
+*   everybody does what only touches themselves, then the kills go in
+*   order of priority, against wherever their victims were at the start
+*   of the step. Last, each tile somebody wants to move or be born into
+*   goes to whoever has the highest priority, nobody else gets it.
+*/
+void commit_intents(struct world *w, struct statistics *stats, uint32_t n)
+{
+	uint32_t kills = 0;
+
+	for(uint32_t i = 0; i < n; i++) {
+		struct intent *in = &w->intents[i];
+		uint32_t c = in->cell;
+
+		if(!in->woke)
+			continue;
+
+		world_wake_cell(w, c);
+		if(CELL_ENERGY(w, c) >= 8 &&
+			unlikely(birth_roll(w, c, w->iters))) {
+			size_t t = CELL_TILE(w, c), f;
+			uint32_t y = world_row(w, t) - 1;
+
+			f = index_forward(w, t - (y + 1) * w->stride - 1, y,
+				CELL_COMPASS(w, c));
+			if(TILE_TYPE(w, f) != 2)
+				in->nursery = f;
+		}
+	}
+
+	for(uint32_t i = 0; i < n; i++) {
+		struct intent *in = &w->intents[i];
+
+		for(int j = 0; j < in->n_osc; j++)
+			carry_out(w, in, in->osc[j]);
+
+		if(in->act.op == ACT_SUICIDE)
+			count_outcome(stats, in, carry_out(w, in, in->act));
+		else if(in->act.op == ACT_KILL_FORWARD ||
+			in->act.op == ACT_KILL_BACKWARD)
+			w->intent_order[kills++] = (struct intent_key){
+				priority(w, in->cell), in->cell, i
+			};
+	}
+
+	qsort(w->intent_order, kills, sizeof(*w->intent_order), key_order);
+	for(uint32_t k = 0; k < kills; k++) {
+		struct intent *in = &w->intents[w->intent_order[k].intent];
+
+		/* got killed first, nothing is born until after this */
+		if(CELL_TILE(w, in->cell) & POOL_FREE)
+			continue;
+
+		count_outcome(stats, in, carry_out(w, in, in->act));
+	}
+
+	/* before anything is born, the handles of the dead get handed out */
+	for(uint32_t i = 0; i < n; i++) {
+		struct intent *in = &w->intents[i];
+
+		if(in->cell == NO_CELL ||
+			(CELL_TILE(w, in->cell) & POOL_FREE)) {
+			in->cell = NO_CELL;
+			continue;
+		}
+
+		if(in->nursery != NOWHERE)
+			stake(w, i << 1 | 1, in->nursery);
+		if(is_move(in->act.op))
+			stake(w, i << 1, in->target);
+	}
+
+	/* children first, the parents move off with the compass they had */
+	for(uint32_t i = 0; i < n; i++) {
+		struct intent *in = &w->intents[i];
+
+		if(in->nursery != NOWHERE &&
+			w->claims[in->nursery] == (i << 1 | 1) &&
+			CELL_ENERGY(w, in->cell) >= 8)
+			give_birth(w, stats, in->cell, in->nursery);
+	}
+
+	for(uint32_t i = 0; i < n; i++) {
+		struct intent *in = &w->intents[i];
+
+		if(in->cell == NO_CELL)
+			continue;
+
+		if(is_move(in->act.op) && w->claims[in->target] == i << 1)
+			carry_out(w, in, in->act);
+
+		CELL_ACTIONS(w, in->cell) = in->actions;
+		CELL_UPDATED(w, in->cell) = w->parity;
+		if(CELL_INERT(w, in->cell) && w->dormancy && !in->woke)
+			world_park_cell(w, in->cell);
+	}
+
+	for(uint32_t i = 0; i < n; i++) {
+		if(w->intents[i].nursery != NOWHERE)
+			w->claims[w->intents[i].nursery] = NO_CLAIM;
+		if(w->intents[i].target != NOWHERE)
+			w->claims[w->intents[i].target] = NO_CLAIM;
+	}
+}
@@ -0,0 +1,61 @@
+/*  SPDX-License-Identifier: GPL-3.0-only
+*   Cellular life simulation following strict rules
+*   Copyright (C) 2023 Teresa Maria Rivera
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "include/cpu.h"
+
+/* -1 until somebody asks, every thread works out the same thing anyway */
+static int level = -1;
+
+/*  __builtin_cpu_supports checks the OS saves the wide registers too, a
+*   cpu with AVX under an OS that doesn't know about it can't use it
+*/
+static int detect(void)
+{
+	__builtin_cpu_init();
+
+	if(!__builtin_cpu_supports("sse4.2") ||
+		!__builtin_cpu_supports("popcnt") ||
+		!__builtin_cpu_supports("aes"))
+		return CPU_SCALAR;
+
+	if(!__builtin_cpu_supports("avx2") ||
+		!__builtin_cpu_supports("bmi") ||
+		!__builtin_cpu_supports("bmi2") ||
+		!__builtin_cpu_supports("lzcnt"))
+		return CPU_SSE42;
+
+	if(!__builtin_cpu_supports("avx512f") ||
+		!__builtin_cpu_supports("avx512bw") ||
+		!__builtin_cpu_supports("avx512vl") ||
+		!__builtin_cpu_supports("avx512dq"))
+		return CPU_AVX2;
+
+	return CPU_AVX512;
+}
+
+int cpu_level(void)
+{
+	static const char *const names[] = {
+		"scalar", "sse4.2", "avx2", "avx512"
+	};
+	int l = __atomic_load_n(&level, __ATOMIC_RELAXED);
+	const char *want;
+
+	if(l >= 0)
+		return l;
+
+	l = detect();
+
+	/* never up, only down, a kernel the cpu can't run is a SIGILL */
+	want = getenv("CELLS_CPU");
+	for(int i = 0; want != NULL && i < l; i++)
+		if(strcmp(want, names[i]) == 0)
+			l = i;
+
+	__atomic_store_n(&level, l, __ATOMIC_RELAXED);
+	return l;
+}
@@ -4,30 +4,256 @@
 */
 
 #include <string.h>
+#include <math.h>
 #include "include/genetics.h"
-#include "include/rng.h"
 #include "include/util.h"
 
-extern generator_handle main_rng;
+void decode_genes(gene_t genes[4], struct gene_prog prog[4])
+{
+	for(int i = 0; i < 4; i++) {
+		genes[i] = SANITIZE_GENE(genes[i]);
+		prog[i].input  = (genes[i] & GENE_INPUT_BITS) >> 24;
+		prog[i].output = genes[i] & GENE_OUTPUT_BITS;
+
+		/* do some weird math to make a strength that is limited
+		*  but not flat, ie changes after hitting 4. Makes things more
+		* interesting
+		*/
+		prog[i].strength = 4 * sinf(0.25 * strength_to_float(
+			(uint16_t)((genes[i] & GENE_STRENGTH_BITS) >> 8)
+		));
+		prog[i].fixed = strength_to_fixed(
+			(uint16_t)((genes[i] & GENE_STRENGTH_BITS) >> 8));
+	}
+}
+
+void compile_genes(const struct gene_prog prog[4],
+	struct gene_action act[4][3])
+{
+	for(int i = 0; i < 4; i++) {
+		switch(prog[i].input) {
+			case GENE_AGE:
+			case GENE_ENERGY:
+			case GENE_DENSITY:
+			for(int v = 0; v < 3; v++)
+				act[i][v] = (struct gene_action){ ACT_SENSE, 0 };
+			break;
+
+			default:
+			/* the same scale and clamp as step_cell */
+			for(int v = 0; v < 3; v++) {
+				float in = (float)(v - 1) * prog[i].strength;
+				in = fminf(fmaxf(in, -4.0), 4.0);
+				act[i][v] = decide_action(prog[i].output, in);
+			}
+			break;
+		}
+	}
+}
+
+void compile_genes_fixed(const struct gene_prog prog[4],
+	struct gene_action act[4][3])
+{
+	for(int i = 0; i < 4; i++) {
+		switch(prog[i].input) {
+			case GENE_AGE:
+			case GENE_ENERGY:
+			case GENE_DENSITY:
+			for(int v = 0; v < 3; v++)
+				act[i][v] = (struct gene_action){ ACT_SENSE, 0 };
+			break;
+
+			default:
+			for(int v = 0; v < 3; v++)
+				act[i][v] = decide_action_fixed(prog[i].output,
+					scale_fixed((v - 1) * FIXED_ONE,
+						prog[i].fixed));
+			break;
+		}
+	}
+}
+
+void vectorize_genes(const struct gene_prog prog[4],
+	struct gene_lanes *lanes)
+{
+	memset(lanes, 0, sizeof(*lanes));
+
+	for(int i = 0; i < 4; i++) {
+		float hi = INFINITY, lo = -INFINITY;
+		uint8_t on_hi = ACT_NONE, on_lo = ACT_NONE;
+
+		/* the thresholds are the ones in decide_action */
+		switch(prog[i].output) {
+			case GENE_MOVE_X:
+			hi = 1.0f, on_hi = ACT_MOVE_EAST;
+			lo = -1.0f, on_lo = ACT_MOVE_WEST;
+			break;
+
+			case GENE_MOVE_Y:
+			hi = 1.0f, on_hi = ACT_MOVE_NORTH;
+			lo = -1.0f, on_lo = ACT_MOVE_SOUTH;
+			break;
+
+			case GENE_MOVE_FORWARD:
+			hi = 1.0f, on_hi = ACT_MOVE_FORWARD;
+			lo = -1.0f, on_lo = ACT_MOVE_BACKWARD;
+			break;
+
+			case GENE_COMMIT_SUICIDE:
+			hi = 3.5f, on_hi = ACT_SUICIDE;
+			lo = -3.5f, on_lo = ACT_SUICIDE;
+			break;
+
+			case GENE_KILL_FORWARD:
+			hi = 2.0f, on_hi = ACT_KILL_FORWARD;
+			lo = -2.0f, on_lo = ACT_KILL_BACKWARD;
+			break;
+
+			case GENE_SET_OSCILATOR:
+			lanes->osc |= 1 << i;
+			break;
+		}
+
+		lanes->strength[i] = prog[i].strength;
+		lanes->hi[i] = hi;
+		lanes->lo[i] = lo;
+		lanes->on_hi[i] = on_hi;
+		lanes->on_lo[i] = on_lo;
+	}
+}
+
+/*  How big a gene's input can ever get, either way. map_range doesn't clamp,
+*   so age runs up to 2 by the time a cell dies of it, and energy doesn't
+*   stop anywhere sensible.
+*/
+static float input_bound(uint8_t op)
+{
+	switch(op) {
+		case 0:
+		return 0.0f;
+
+		case GENE_AGE:
+		return 2.0f;
+
+		case GENE_ENERGY:
+		return INFINITY;
+
+		case GENE_DENSITY:
+		return 0.5f;
+
+		default:
+		return 1.0f;
+	}
+}
+
+/* the same in fixed point, INT64_MAX for no bound */
+static int64_t input_bound_fixed(uint8_t op)
+{
+	switch(op) {
+		case 0:
+		return 0;
+
+		case GENE_AGE:
+		return 2 * FIXED_ONE;
+
+		case GENE_ENERGY:
+		return INT64_MAX;
+
+		case GENE_DENSITY:
+		return FIXED_ONE / 2;
+
+		default:
+		return FIXED_ONE;
+	}
+}
+
+/*  Whether a gene can't ever do anything. Every output but the oscillator
+*   does nothing on an interval around 0, so it's enough to check both ends
+*   of what the scaled input can reach. The oscillator fires on [0.01, 0.02)
+*   too, it only stays quiet under 0.01.
+*/
+static bool gene_inert(const struct gene_prog *p)
+{
+	float b = input_bound(p->input), m;
+
+	/* NaNs come out as -4, an infinite strength ends up NaN or 4 */
+	if(isnan(p->strength) || isinf(p->strength))
+		m = 4.0f;
+	else if(p->strength == 0.0f || b == 0.0f)
+		m = 0.0f;
+	else
+		m = fminf(b * fabsf(p->strength), 4.0f);
+
+	if(p->output == GENE_SET_OSCILATOR)
+		return m < 0.01f;
+
+	return decide_action(p->output, m).op == ACT_NONE &&
+		decide_action(p->output, -m).op == ACT_NONE;
+}
+
+/*  The same off the fixed point strength alone, no floats anywhere, so the
+*   fixed modes park the same cells whatever sinf the host has.
+*/
+static bool gene_inert_fixed(const struct gene_prog *p)
+{
+	int64_t b = input_bound_fixed(p->input);
+	fixed_t m;
+
+	if(p->fixed == FIXED_NAN)
+		m = 4 * FIXED_ONE;
+	else if(p->fixed == 0 || b == 0)
+		m = 0;
+	else if(b == INT64_MAX)
+		m = 4 * FIXED_ONE;
+	else
+		m = abs(scale_fixed(b, p->fixed));
+
+	if(p->output == GENE_SET_OSCILATOR)
+		return ((int64_t)m * 100 >> FIXED_SHIFT) == 0;
+
+	return decide_action_fixed(p->output, m).op == ACT_NONE &&
+		decide_action_fixed(p->output, -m).op == ACT_NONE;
+}
+
+bool inert_genes(const struct gene_prog prog[4], bool fixed)
+{
+	for(int i = 0; i < 4; i++)
+		if(!(fixed ? gene_inert_fixed(&prog[i]) : gene_inert(&prog[i])))
+			return false;
+
+	return true;
+}
+
+/* a random bit of the low byte of one of the genes */
+static inline void flip_gene_bit(gene_t genes[4], uint64_t *dice)
+{
+	uint64_t r = mix64_next(dice);
+
+	genes[(uint8_t)r % 4] ^= 1 << (uint8_t)(r >> 8) % 8;
+}
 
 /* handles inheritance + mutation */
-void duplicate_genes(gene_t parent[4], gene_t child[4]) {
-	uint16_t dice_roll_a = gen16(main_rng);
+bool duplicate_genes(gene_t parent[4], gene_t child[4], uint64_t dice) {
+	uint16_t dice_roll_a = mix64_next(&dice);
 	memcpy(child, parent, 16);
 
 	if(dice_roll_a == 0xabcd) {
-		child[gen8(main_rng) % 4] ^= 1 << gen8(main_rng) % 8;
+		flip_gene_bit(child, &dice);
 
 		if(unlikely(
-			(gen64(main_rng) & 0xffffffffffff) == 0x63616d626961
-		))
-			parent[gen8(main_rng) % 4] ^= 1 << gen8(main_rng) % 8;
+			(mix64_next(&dice) & 0xffffffffffff) == 0x63616d626961
+		)) {
+			flip_gene_bit(parent, &dice);
+			return true;
+		}
 	} else if(dice_roll_a == 0xef00) {
-		parent[gen8(main_rng) % 4] ^= 1 << gen8(main_rng) % 8;
+		flip_gene_bit(parent, &dice);
 		
 		if(unlikely(
-			(gen64(main_rng) & 0xffffffffffff) == 0x63616d626961
+			(mix64_next(&dice) & 0xffffffffffff) == 0x63616d626961
 		))
-			child[gen8(main_rng) % 4] ^= 1 << gen8(main_rng) % 8;
+			flip_gene_bit(child, &dice);
+		return true;
 	}
+	return false;
 }
\ No newline at end of file
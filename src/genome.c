@@ -0,0 +1,149 @@
+/*  SPDX-License-Identifier: GPL-3.0-only
+*   Cellular life simulation following strict rules
+*   Copyright (C) 2023 Teresa Maria Rivera
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "include/genome.h"
+#include "include/util.h"
+
+static inline uint32_t genome_hash(const gene_t genes[4])
+{
+	uint64_t a = genes[0] | (uint64_t)genes[1] << 32;
+	uint64_t b = genes[2] | (uint64_t)genes[3] << 32;
+
+	a *= UINT64_C(0x9e3779b97f4a7c15);
+	a ^= a >> 29;
+	a ^= b;
+	a *= UINT64_C(0xc2b2ae3d27d4eb4f);
+	return a >> 32;
+}
+
+/* a bucket per live entry at most, past that the chains get long */
+static void genome_rehash(struct genome_table *t, uint32_t buckets)
+{
+	free(t->buckets);
+	t->buckets = malloc(buckets * sizeof(*t->buckets));
+	die(t->buckets == NULL, "Couldn't grow the genome table");
+
+	memset(t->buckets, 0xff, buckets * sizeof(*t->buckets));
+	t->bucket_mask = buckets - 1;
+
+	for(uint32_t g = 0; g < t->top; g++) {
+		uint32_t *b;
+
+		if(GENOME(t, g).refs == 0)
+			continue;
+
+		b = &t->buckets[genome_hash(GENOME(t, g).genes) & t->bucket_mask];
+		GENOME(t, g).next = *b;
+		*b = g;
+	}
+}
+
+void genome_init(struct genome_table *t, uint32_t capacity)
+{
+	uint32_t buckets = 64;
+
+	while(buckets < capacity)
+		buckets *= 2;
+
+	ZERO_STRUCT(*t);
+	t->capacity = capacity;
+	t->free = GENOME_NONE;
+	t->genomes = malloc(capacity * sizeof(*t->genomes));
+	die(t->genomes == NULL, "Couldn't allocate the genome table");
+
+	genome_rehash(t, buckets);
+}
+
+void genome_free_table(struct genome_table *t)
+{
+	free(t->genomes);
+	free(t->buckets);
+	ZERO_STRUCT(*t);
+}
+
+uint32_t genome_intern(struct genome_table *t, const gene_t genes[4])
+{
+	gene_t clean[4];
+	uint32_t h, g;
+
+	for(int i = 0; i < 4; i++)
+		clean[i] = SANITIZE_GENE(genes[i]);
+
+	h = genome_hash(clean);
+	for(g = t->buckets[h & t->bucket_mask]; g != GENOME_NONE;
+		g = GENOME(t, g).next) {
+		if(memcmp(GENOME(t, g).genes, clean, sizeof(clean)) == 0) {
+			GENOME(t, g).refs++;
+			return g;
+		}
+	}
+
+	/* a new species */
+	if(t->free != GENOME_NONE) {
+		g = t->free;
+		t->free = GENOME(t, g).next;
+	} else {
+		if(unlikely(t->top == t->capacity)) {
+			t->capacity *= 2;
+			t->genomes = realloc(t->genomes,
+				t->capacity * sizeof(*t->genomes));
+			die(t->genomes == NULL, "Couldn't grow the genome table");
+		}
+		g = t->top++;
+	}
+
+	memcpy(GENOME(t, g).genes, clean, sizeof(clean));
+	decode_genes(GENOME(t, g).genes, GENOME(t, g).prog);
+	compile_genes(GENOME(t, g).prog, GENOME(t, g).act);
+	compile_genes_fixed(GENOME(t, g).prog, GENOME(t, g).act_fixed);
+	vectorize_genes(GENOME(t, g).prog, &GENOME(t, g).lanes);
+	pick_handlers(GENOME(t, g).prog, GENOME(t, g).handler);
+	GENOME(t, g).inert = inert_genes(GENOME(t, g).prog, false);
+	GENOME(t, g).inert_fixed = inert_genes(GENOME(t, g).prog, true);
+	GENOME(t, g).refs = 1;
+	t->count++;
+
+	if(t->count > t->bucket_mask + 1) {
+		genome_rehash(t, (t->bucket_mask + 1) * 2);
+	} else {
+		GENOME(t, g).next = t->buckets[h & t->bucket_mask];
+		t->buckets[h & t->bucket_mask] = g;
+	}
+
+	return g;
+}
+
+void genome_reserve(struct genome_table *t, uint32_t n)
+{
+	if(t->top + n <= t->capacity)
+		return;
+
+	while(t->top + n > t->capacity)
+		t->capacity *= 2;
+
+	t->genomes = realloc(t->genomes, t->capacity * sizeof(*t->genomes));
+	die(t->genomes == NULL, "Couldn't grow the genome table");
+}
+
+void genome_release(struct genome_table *t, uint32_t g)
+{
+	uint32_t *p;
+
+	if(--GENOME(t, g).refs)
+		return;
+
+	/* last one of the species is gone, take it off its chain */
+	p = &t->buckets[genome_hash(GENOME(t, g).genes) & t->bucket_mask];
+	while(*p != g)
+		p = &GENOME(t, *p).next;
+	*p = GENOME(t, g).next;
+
+	GENOME(t, g).next = t->free;
+	t->free = g;
+	t->count--;
+}
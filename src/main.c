@@ -50,7 +50,8 @@ struct args {
 	int flags;
 };
 
-generator_handle main_rng;
+/* every thread stepping stripes gets its own */
+_Thread_local generator_handle main_rng;
 
 static inline void parse_long_args(struct args *args, int i, int argc, 
 	const char *arg, const char **argv) 
@@ -112,24 +113,23 @@ static inline struct args parse_args(int argc, const char **argv)
 static inline void simulation(struct args *args, int w) 
 {
 	struct world world;
-	struct statistics highest; /* each of the highest values */
-	struct statistics lowest; /* each of the lowest values */
-	struct statistics average; /* more like totals */
-	struct statistics current; /* essentially a temporary variable */
-	int i;
+	struct run_totals totals; /* highest, lowest and summed over the run */
+	unsigned int i, n;
+	int stop = ((args->flags >> 1) & 1) ? RUN_STOP_EXTINCT : 0;
 	init_world(
 		&world, args->width, args->height, 
 		args->food_to_generate, args->cells_per_world
 	);
 
-	ZERO_STRUCT(highest);
-	ZERO_STRUCT(lowest);
-	ZERO_STRUCT(average);
-	ZERO_STRUCT(current);
+	ZERO_STRUCT(totals);
 
 	puts("Starting simulation");
-	for(i = 0; i < args->max_generations; i++) {
-		if(i % args->iters_per_frame) {
+	for(i = 0; i < args->max_generations; i += n) {
+		/* a frame, then all the steps up to the next one in one go */
+		n = min(args->iters_per_frame, args->max_generations - i);
+		n = n ? n : 1;
+
+		{
 			char *file = malloc(snprintf(NULL, 0, "%s/%i-%i.png", 
 				args->dest_folder, 
 				args->starting_world_number+w,
@@ -157,40 +157,13 @@ static inline void simulation(struct args *args, int w)
 			rs.write_to_file = true;
 			render(&world, file, rs);
 		}
-		
-		step_world(&world, &current);
-
-		/* statistics */
-		highest.births   = max(current.births,  highest.births);
-		highest.death    = max(current.death,   highest.death);
-		highest.food     = max(current.food,    highest.food);
-		highest.murder   = max(current.murder,  highest.murder);
-		highest.old_age  = max(current.old_age, highest.old_age);
-		highest.pop      = max(current.pop,     highest.pop);
-		highest.starve   = max(current.starve,  highest.starve);
-		highest.suicide  = max(current.suicide, highest.suicide);
-
-		lowest.births    = min(current.births,  lowest.births);
-		lowest.death     = min(current.death,   lowest.death);
-		lowest.food      = min(current.food,    lowest.food);
-		lowest.murder    = min(current.murder,  lowest.murder);
-		lowest.old_age   = min(current.old_age, lowest.old_age);
-		lowest.pop       = min(current.pop,     lowest.pop);
-		lowest.starve    = min(current.starve,  lowest.starve);
-		lowest.suicide   = min(current.suicide, lowest.suicide);
-
-		average.births  += current.births;
-		average.death   += current.death;
-		average.food    += current.food;
-		average.murder  += current.murder;
-		average.old_age += current.old_age;
-		average.pop     += current.pop;
-		average.starve  += current.starve;
-		average.suicide += current.suicide;
-
-		ZERO_STRUCT(current);
-
-		if(world_has_life(&world) && ((args->flags >> 1) & 1))
+
+		/*  Stops inside the batch when the last cell dies, and the
+		*   check after it also catches a world dying on the batch's last
+		*   step, so an empty world is never rendered or stepped again
+		*/
+		step_world_n(&world, n, &totals, stop);
+		if(stop && !world_has_life(&world))
 			break;
 	}
 
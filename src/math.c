@@ -3,15 +3,87 @@
 *   Copyright (C) 2023 Teresa Maria Rivera
 */
 
+#include <string.h>
 #include "include/math.h"
 #include "include/genetics.h"
 
 float strength_to_float(uint16_t strength) {
-	uint32_t tmp = 0;
-	tmp |= (strength >> 15) << 31; /* extract sign bit */
-	tmp |= (((strength >> 10) & 0x1f) - 15) + 127; /* extract exponent */
-	tmp |= (strength) & 0x3ff; /* extract and apply mantissa */
-	return *(float*)&tmp; /* final conversion */
+	uint32_t exp = (strength >> 10) & 0x1f, man = strength & 0x3ff;
+	uint32_t tmp = (uint32_t)(strength >> 15) << 31; /* extract sign bit */
+	float f;
+
+	if(exp == 0x1f) {
+		/* infinity and nan stay that way */
+		tmp |= UINT32_C(0xff) << 23 | man << 13;
+	} else if(exp != 0) {
+		/* rebias the exponent and put everything where fp32 has it */
+		tmp |= (exp - 15 + 127) << 23 | man << 13;
+	} else if(man != 0) {
+		/* fp16 denormals are normal in fp32, shift them up until they are */
+		exp = 127 - 14;
+		while(!(man & 0x400)) {
+			man <<= 1;
+			exp--;
+		}
+		tmp |= exp << 23 | (man & 0x3ff) << 13;
+	}
+
+	memcpy(&f, &tmp, sizeof(f)); /* final conversion */
+	return f;
+}
+
+/* 2^64/(8*pi), strength/4 radians times this is the angle in Q64 turns */
+#define QUARTER_RAD_TURNS UINT64_C(733972625820500307)
+/* pi/2 in Q30 */
+#define HALF_PI_Q30 INT64_C(1686629713)
+#define ONE_Q30     (INT64_C(1) << 30)
+
+fixed_t strength_to_fixed(uint16_t strength) {
+	uint32_t exp = (strength >> 10) & 0x1f, man = strength & 0x3ff;
+	uint32_t phase, r;
+	unsigned __int128 turns;
+	int64_t x, x2, s;
+	int e;
+
+	if(exp == 0x1f)
+		return FIXED_NAN; /* sinf gives nan for infinity too */
+
+	/* the strength is man * 2^e */
+	if(exp == 0) {
+		e = -24;
+	} else {
+		man |= 0x400;
+		e = exp - 25;
+	}
+
+	/* only the fraction of a turn matters, the top 32 bits of it */
+	turns = (unsigned __int128)man * QUARTER_RAD_TURNS;
+	turns = e >= 0 ? turns << e : turns >> -e;
+	phase = (uint64_t)turns >> 32;
+
+	/* fold it into the first quadrant, in radians */
+	r = phase & (ONE_Q30 - 1);
+	if(phase & (1u << 30))
+		r = ONE_Q30 - r;
+	x = (r * HALF_PI_Q30) >> 30;
+	x2 = (x * x) >> 30;
+
+	/* sin x = x(1 - x^2/6(1 - x^2/20(1 - x^2/42(...)))), plenty for Q16 */
+	s = ONE_Q30;
+	for(int k = 13; k > 1; k -= 2)
+		s = ONE_Q30 - ((x2 * s) >> 30) / (k * (k - 1));
+	s = (x * s) >> 30;
+
+	/* times 4, Q30 to Q16, and the sign from the quadrant and strength */
+	s = (s + (1 << 11)) >> 12;
+	if(((phase >> 31) ^ (strength >> 15)) & 1)
+		s = -s;
+	return s;
+}
+
+int64_t map_range_fixed(int64_t x, int64_t src1, int64_t src2,
+	int64_t dst1, int64_t dst2) {
+	return src1 + (((x - src1) * (dst2 - dst1))/(src2 - src1));
 }
 
 uint32_t isqrt(uint32_t i) {
@@ -8,37 +8,61 @@
 #include "include/render.h"
 #include "include/world.h"
 #include "include/math.h"
+#include "include/cpu.h"
 #include "include/lib/stb_image_write.h"
 
-#define COLOR_HASH(x) ({ \
-	uint32_t __v = __builtin_popcount(x); \
-	__v = (__v) ? __v * __v * __v * 2 : 1; \
-	(isqrt(__v) & 0xff); \
-})
+/*  isqrt(2 * n^3) & 0xff for every number of bits a gene can have set, and
+*   1 for none, worked out once instead of for every cell of every frame
+*/
+static const uint8_t color_hash[33] = {
+	1, 1, 4, 7, 11, 15, 20, 26, 32, 38, 44, 51, 58, 66, 74, 82, 90,
+	99, 108, 117, 126, 136, 145, 155, 166, 176, 187, 198, 209, 220, 232,
+	244, 0
+};
+
+#define COLOR_HASH(x) (color_hash[__builtin_popcount(x)])
 
 #define INDEX_RGBA(c, i) (0xff & (x >> (32 - (8 * (i + 1)))))
 
-uint32_t default_colorgen(struct tile *t) 
+/*  Inlined into each level below, so the popcounts of the genes are one
+*   POPCNT where it's there instead of a call into libgcc, for every tile
+*   of every frame
+*/
+__attribute__((__always_inline__))
+static inline uint32_t colorgen(struct world *w, size_t i)
 {
-	if(t->type == 0)
+	if(TILE_TYPE(w, i) == 0)
 		return RGBA(0xff, 0xff, 0xff, 0);
-	else if(t->type == 1) {
-		uint32_t tmp = 0xff - ((t->dead.energy & 0xff) >> 2);
+	else if(TILE_TYPE(w, i) == 1) {
+		uint32_t tmp = 0xff - ((TILE_ENERGY(w, i) & 0xff) >> 2);
 		return RGBA(0xff - tmp, 0 - tmp, 0 - tmp, 0xff);
 	} else {
-		uint32_t r = COLOR_HASH(t->cell.genes[0]),
-			 g = COLOR_HASH(t->cell.genes[1]),
-			 b = COLOR_HASH(t->cell.genes[2]),
+		uint32_t h = TILE_HANDLE(w, i),
+			 r = COLOR_HASH(CELL_GENES(w, h)[0]),
+			 g = COLOR_HASH(CELL_GENES(w, h)[1]),
+			 b = COLOR_HASH(CELL_GENES(w, h)[2]),
 			 a = 255,
-			 tmp = 0xff - ((t->cell.energy & 0xff) >> 2);
+			 tmp = 0xff - ((CELL_ENERGY(w, h) & 0xff) >> 2);
 		return RGBA(r - tmp, g - tmp, b - tmp, a - tmp);
 	}
 }
 
+uint32_t default_colorgen(struct world *w, size_t i) 
+{
+	return colorgen(w, i);
+}
+
+__attribute__((CPU_TARGET_SSE42))
+static uint32_t default_colorgen_sse42(struct world *w, size_t i)
+{
+	return colorgen(w, i);
+}
+
 struct render_settings render_defaults()
 {
 	struct render_settings ret;
-	ret.color_gen = default_colorgen;
+	ret.color_gen = cpu_level() >= CPU_SSE42 ?
+		default_colorgen_sse42 : default_colorgen;
 	ret.encoding = 2;
 	ret.write_to_file = false;
 
@@ -51,11 +75,14 @@ void *render(struct world *w, const char *filename,
 	int color_size = (settings.encoding - 1) ? 3 : 4;
 	uint8_t *fb = malloc(w->height * w->length * color_size);
 	unsigned int x = w->length, y =  w->height;
+
+	/* parked cells haven't been charged in a while, the colours show energy */
+	world_sync(w);
 	
 	for(int i = 0; i < x; i++) {
 		for(int j = y-1; j != 0; j--) {
 			uint32_t c = settings.color_gen(
-				&INDEX_WORLD((*w), i, j)
+				w, INDEX_WORLD((*w), i, j)
 			);
 
 			fb[((x * j) + i) * 3 + 0] = INDEX_RGBA(c, 0);
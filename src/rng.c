@@ -4,6 +4,8 @@
 */
 
 #include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include <wmmintrin.h> 
 #include <stdlib.h>
 #include <string.h>
@@ -25,6 +27,7 @@
 #endif
 
 #include "include/rng.h"
+#include "include/cpu.h"
 
 #define ROL(x, a) (((x) << (a)) | ((x) >> (32 - (a))))
 #define ROR(x, b) (((x) >> (a)) | ((x) << (32 - (a))))
@@ -115,25 +118,81 @@ static void aes_keygen(__m128i key, uint32_t *keys)
 	}
 }
 
+/* one round of aes on a block, what AESENC does, or AESENCLAST if last */
+static __m128i aes_round(__m128i block, __m128i key, bool last)
+{
+	_Alignas(16) uint8_t s[16], t[16];
+	_Alignas(16) uint32_t col[4];
+
+	/* SubBytes a column at a time, byte r + 4c is row r of column c */
+	_mm_store_si128((__m128i *)col, block);
+	for(int c = 0; c < 4; c++)
+		col[c] = aes_subword(col[c]);
+	memcpy(s, col, sizeof(s));
+
+	/* ShiftRows */
+	for(int c = 0; c < 4; c++)
+		for(int r = 0; r < 4; r++)
+			t[r + 4 * c] = s[r + 4 * ((c + r) % 4)];
+
+	/* MixColumns, xtime is multiplying by 2 in GF(2^8) */
+	for(int c = 0; !last && c < 4; c++) {
+		uint8_t *a = &t[4 * c], x[4];
+
+		for(int r = 0; r < 4; r++)
+			x[r] = (a[r] << 1) ^ (a[r] & 0x80 ? 0x1b : 0);
+
+		s[4 * c + 0] = x[0] ^ x[1] ^ a[1] ^ a[2] ^ a[3];
+		s[4 * c + 1] = a[0] ^ x[1] ^ x[2] ^ a[2] ^ a[3];
+		s[4 * c + 2] = a[0] ^ a[1] ^ x[2] ^ x[3] ^ a[3];
+		s[4 * c + 3] = x[0] ^ a[0] ^ a[1] ^ a[2] ^ x[3];
+	}
+
+	return _mm_xor_si128(_mm_load_si128(
+		(__m128i *)(last ? t : s)), key);
+}
+
+/* the rounds of a block, for cpus without AES-NI, comes out the same */
+static __m128i aes_rounds(__m128i ctr, const uint32_t *key)
+{
+	__m128i tmp = _mm_loadu_si128((const __m128i *)key);
+
+	for(int k = 0; k < 15; k++)
+		ctr = aes_round(ctr, tmp, k == 14);
+
+	return ctr;
+}
+
+/* intel intrinsics make our lives easier */
+__attribute__((CPU_TARGET_SSE42))
+static __m128i aes_rounds_ni(__m128i ctr, const uint32_t *key)
+{
+	__m128i tmp = _mm_loadu_si128((const __m128i *)key);
+
+	for(int k = 0; k < 15; k++) {
+		if(k == 14)
+			ctr = _mm_aesenclast_si128(ctr, tmp);
+		else
+		 	ctr = _mm_aesenc_si128(ctr, tmp);
+	}
+
+	return ctr;
+}
+
 /* aes for fun */
 static void aes(struct rng_generator *g) 
 {
-	/* intel intrinsics make our lives easier */
 	__m128i key = _mm_load_si128(g);
+	bool ni = cpu_level() >= CPU_SSE42;
+
 	for(int i = 0; i < 8; i += 2, g->ctr++) {
 		__m128i ctr = _mm_load_si128(&g->iv);
 		__m128i tmp;
 		uint32_t keybuf[8*15]; /* 4R */
 		aes_keygen(key, keybuf);
 
-		for(int k = 0; k < 15; k++) {
-			tmp = _mm_load_si128(&keybuf[i * 4]);
-
-			if(k == 14)
-				ctr = _mm_aesenclast_si128(ctr, tmp);
-			else
-			 	ctr = _mm_aesenc_si128(ctr, tmp);
-		}
+		ctr = ni ? aes_rounds_ni(ctr, &keybuf[i * 4]) :
+			aes_rounds(ctr, &keybuf[i * 4]);
 
 		tmp = _mm_load_si128(&g->state[i]);
 		_mm_store_si128(&g->state[i], _mm_xor_si128(tmp, ctr));
@@ -218,6 +277,26 @@ void reseed(generator_handle h) {
 	aes(h);
 }
 
+void reseed_from(generator_handle h, generator_handle from) {
+	uint64_t *seed = (uint64_t*)h;
+
+	/*  all of it up to byte_ctr, not just the 104 bytes reseed reads, aes
+	*   mixes into the state and whatever h had in there before would stay
+	*   (gen_bytes can't do that much at once)
+	*/
+	for(size_t i = 0; i < offsetof(struct rng_generator, byte_ctr) / 8; i++)
+		seed[i] = gen64(from);
+
+	h->byte_ctr = 0;
+	h->ctr      = 0;
+
+	aes(h);
+}
+
+void copy_generator(generator_handle dst, generator_handle src) {
+	memcpy(dst, src, sizeof(*dst));
+}
+
 void refresh(generator_handle h) {
 	/* every ~16,777,216 bytes, use aes instead of salsa20 */
 	if(((h->ctr << 8) >> 24) > 1) {
@@ -0,0 +1,618 @@
+/*  SPDX-License-Identifier: GPL-3.0-only
+*   Cellular life simulation following strict rules
+*   Copyright (C) 2023 Teresa Maria Rivera
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "include/world.h"
+#include "include/util.h"
+
+/*  STEP_SPECULATE steps the world in STEP_DENSE's raster order, or at least
+*   nobody can tell it didn't. The world is cut into an even number of
+*   stripes of rows like STEP_STRIPES does, and each stripe is stepped in
+*   raster order by one thread, so the only thing that can come out
+*   different from stepping row after row is what happens where two
+*   stripes meet. A stripe run straight after the one above it is fine,
+*   the trouble is every even stripe gets stepped before the odd one above
+*   it, so it sees that stripe as it was at the start of the step.
+*
+*   So every run notes down which tiles near its edges it read and which it
+*   wrote: a cell reads nothing further than one tile out of wherever it is
+*   during its step, so the reads are every tile next to or under where its
+*   cells started from and moved to, the writes are whatever the journal
+*   saved, and the cells' own tiles. If neither of two stripes stepped out
+*   of order wrote anything the other read or wrote, neither could have
+*   seen the other, and it's the same as if they had been in order. If one
+*   did, the one that should have gone second gets rolled back off its
+*   journal and stepped again, on its own, and whatever stepped after it
+*   and saw it gets rolled back too. Cells are sparse and their reach is
+*   short, so that's the odd stripe now and then, not every one.
+*
+*   For that to hold up, nothing a stripe does can depend on anything but
+*   the tiles it touches:
+*   - the dice are the cell's own, keyed by its id and the step, a redone
+*     stripe rolls the same ones again
+*   - children go in slots set aside for the stripe beforehand, a stripe
+*     that runs out while other threads are going is just redone alone
+*   - slots of the dead and genome releases wait for the end of the step,
+*     the census and the stats are kept per stripe
+*   That makes the whole thing come out the same no matter how many
+*   threads do it, or how often stripes get redone, down to the last bit,
+*   one thread just steps the stripes one after the other, and the same as
+*   STEP_DENSE, which rolls the same dice in the same raster order.
+*/
+
+/* rows either side of where two stripes meet that both can touch */
+#define SEAM STEP_REACH
+
+/* at most this many stripes, more only costs more seams to check */
+#define MAX_SLICES 64
+
+/*  What a run did around one of the stripe's edges, 2 * SEAM rows of
+*   length bits each for the tiles read and the ones written
+*/
+struct footprint {
+	uint64_t *reads;
+	uint64_t *writes;
+	bool spilled; /* had a child on the other side, counts as a clash */
+};
+
+struct slice {
+	struct worker k;
+
+	/* its rows, bottom not included */
+	uint32_t top;
+	uint32_t bottom;
+
+	/*  Around the top (0) and bottom (1) edge. base is the reads of the
+	*   cells there at the start of the step, which count for every run
+	*   whether they got to go or not (the stripe next door might have
+	*   killed them), now is the run that's there now and seen every run
+	*   so far this step.
+	*/
+	uint64_t *base[2];
+	struct footprint now[2];
+	struct footprint seen[2];
+
+	/*  When the run that's there now started, 0 for none, the first run
+	*   this step, and the last time a run was rolled back. The parallel
+	*   runs are at 1 and 2, the rest get the next tick of the clock.
+	*/
+	uint32_t ran;
+	uint32_t first;
+	uint32_t undone;
+};
+
+struct speculation {
+	struct world *w;
+	unsigned int threads; /* including the one calling step_world */
+	unsigned int count;   /* of stripes, even, 0 if the world is too small */
+	struct slice *slices;
+
+	uint32_t row_words;  /* words per row of a seam */
+	uint32_t seam_words; /* and per seam */
+	uint32_t clock;
+
+	uint64_t runs;
+	uint64_t redone;
+
+	pthread_t *pool;
+	pthread_barrier_t barrier;
+	unsigned int colour;
+	unsigned int next; /* next stripe of the colour up for grabs */
+	bool quit;
+};
+
+/* row of the seam around edge that row y is on, past 0 or 2 * SEAM if none */
+static inline int32_t seam_row(const struct world *w, uint32_t edge,
+	uint32_t y)
+{
+	int32_t d = (int32_t)y - (int32_t)edge + SEAM;
+
+	/* the seam around the top edge of the world is on both ends */
+	if(d > (int32_t)w->height / 2)
+		d -= w->height;
+	else if(d < -(int32_t)w->height / 2)
+		d += w->height;
+
+	return d;
+}
+
+static inline void set_bit(const struct speculation *p, uint64_t *bits,
+	int32_t r, uint32_t x)
+{
+	uint64_t *row = bits + (size_t)r * p->row_words;
+
+	row[x >> 6] |= UINT64_C(1) << (x & 63);
+}
+
+/* the tile at x, y and the eight around it, whichever are in the seams */
+static void mark(struct world *w, struct speculation *p, struct slice *s,
+	uint64_t *bits[2], uint32_t x, uint32_t y)
+{
+	const uint32_t edge[2] = { s->top, s->bottom };
+	uint32_t xs[3] = { WRAP_DEC(x, w->length), x, WRAP_INC(x, w->length) };
+
+	for(int z = 0; z < 2; z++) {
+		int32_t d = seam_row(w, edge[z], y);
+
+		if(d < -1 || d > 2 * SEAM)
+			continue;
+
+		for(int32_t r = d - 1; r <= d + 1; r++)
+			if(r >= 0 && r < 2 * SEAM)
+				for(int i = 0; i < 3; i++)
+					set_bit(p, bits[z], r, xs[i]);
+	}
+}
+
+/* the tile at t in the writes, the seam it's in if any */
+static void wrote(struct world *w, struct speculation *p, struct slice *s,
+	size_t t)
+{
+	uint32_t y = world_row(w, t) - 1;
+	uint32_t x = t - (size_t)(y + 1) * w->stride - 1;
+	int32_t d;
+
+	if((d = seam_row(w, s->top, y)) >= 0 && d < 2 * SEAM)
+		set_bit(p, s->now[0].writes, d, x);
+	else if((d = seam_row(w, s->bottom, y)) >= 0 && d < 2 * SEAM)
+		set_bit(p, s->now[1].writes, d, x);
+}
+
+/*  a cell is about to act from t, it reads around it and its own fields
+*   get written while it's there
+*/
+void slice_mark(struct world *w, struct slice *s, size_t t)
+{
+	struct speculation *p = w->speculation;
+	uint32_t y = world_row(w, t);
+	uint64_t *reads[2] = { s->now[0].reads, s->now[1].reads };
+
+	mark(w, p, s, reads, t - (size_t)y * w->stride - 1, y - 1);
+	wrote(w, p, s, t);
+}
+
+void slice_wrote(struct world *w, struct slice *s, size_t t)
+{
+	wrote(w, w->speculation, s, t);
+}
+
+void slice_born(struct world *w, struct slice *s, size_t n)
+{
+	uint32_t y = world_row(w, n) - 1;
+	int32_t d = seam_row(w, s->top, y);
+
+	if(y >= s->top && y < s->bottom)
+		return;
+
+	s->now[d >= 0 && d < SEAM ? 0 : 1].spilled = true;
+}
+
+/*  whether either of two stripes' footprints on the seam between them
+*   wrote anything the other one read or wrote, reads always cover writes
+*/
+static bool meets(const struct speculation *p, const struct footprint *a,
+	const struct footprint *b)
+{
+	if(a->spilled || b->spilled)
+		return true;
+
+	for(uint32_t i = 0; i < p->seam_words; i++)
+		if((a->writes[i] & b->reads[i]) | (a->reads[i] & b->writes[i]))
+			return true;
+
+	return false;
+}
+
+static inline struct slice *above(struct speculation *p, struct slice *s)
+{
+	return s == p->slices ? s + p->count - 1 : s - 1;
+}
+
+static inline struct slice *below(struct speculation *p, struct slice *s)
+{
+	return s == p->slices + p->count - 1 ? p->slices : s + 1;
+}
+
+/*  Step the stripe's live cells in raster order, straight off the alive
+*   bitplane, which is the same as STEP_DENSE calling step_cell on every
+*   tile of the rows. Children born ahead show up in the bits before the
+*   scan gets to them, same as they would for STEP_DENSE.
+*/
+static void run(struct speculation *p, struct slice *s, uint32_t clock,
+	bool alone)
+{
+	struct world *w = p->w;
+	size_t i = (size_t)(s->top + 1) * w->stride + 1;
+	size_t last = (size_t)s->bottom * w->stride + w->length;
+
+	s->k.journal = p->threads > 1;
+	s->k.alone = alone;
+	s->ran = clock;
+	if(s->first == 0)
+		s->first = clock;
+
+	if(s->k.journal) {
+		for(int z = 0; z < 2; z++) {
+			memcpy(s->now[z].reads, s->base[z],
+				p->seam_words * sizeof(uint64_t));
+			memset(s->now[z].writes, 0,
+				p->seam_words * sizeof(uint64_t));
+			s->now[z].spilled = false;
+		}
+	}
+
+	this_worker = &s->k;
+
+	while(i <= last) {
+		uint64_t bits = w->alive_bits[i >> 6] >> (i & 63);
+		uint32_t y, x;
+
+		if(bits == 0) {
+			i = (i | 63) + 1;
+			continue;
+		}
+
+		i += __builtin_ctzll(bits);
+		if(i > last)
+			break;
+
+		/* the ghost ring has its bits too */
+		y = world_row(w, i);
+		x = i - (size_t)y * w->stride;
+		if(x >= 1 && x <= w->length)
+			step_cell(w, &s->k.stats, x - 1, y - 1);
+		i++;
+	}
+
+	this_worker = NULL;
+
+	if(s->k.journal) {
+		for(int z = 0; z < 2; z++) {
+			for(uint32_t j = 0; j < p->seam_words; j++) {
+				s->seen[z].reads[j]  |= s->now[z].reads[j];
+				s->seen[z].writes[j] |= s->now[z].writes[j];
+			}
+			s->seen[z].spilled |= s->now[z].spilled;
+		}
+	}
+}
+
+/*  Roll a run back. Anything run since that clashed with it has to go
+*   first, the journals have to be undone newest first where they meet.
+*/
+static void undo(struct speculation *p, struct slice *s)
+{
+	struct slice *a = above(p, s), *b = below(p, s);
+
+	if(a->ran > s->ran && meets(p, &a->now[1], &s->now[0]))
+		undo(p, a);
+	if(b->ran > s->ran && meets(p, &b->now[0], &s->now[1]))
+		undo(p, b);
+
+	this_worker = &s->k;
+	world_undo(p->w, &s->k);
+	this_worker = NULL;
+
+	s->ran = 0;
+	s->undone = p->clock++;
+	p->redone++;
+}
+
+/*  n's side of the seam against s's, n goes first in raster order: s had
+*   to have seen n the way it ended up, either it ran after n's last run
+*   and nothing of n got rolled back since, or nothing n ever did clashed
+*   with what s did
+*/
+static bool after(const struct speculation *p, const struct slice *n,
+	const struct footprint *seen, const struct slice *s,
+	const struct footprint *now)
+{
+	if(n->ran < s->ran && n->undone < s->ran)
+		return true;
+
+	return !meets(p, seen, now);
+}
+
+/*  n goes after s: s can't have seen anything n did, whatever of n was
+*   there while s ran (rolled back since or not) can't clash with it
+*/
+static bool before(const struct speculation *p, const struct slice *n,
+	const struct footprint *nnow, const struct footprint *seen,
+	const struct slice *s, const struct footprint *now)
+{
+	if(n->ran && n->ran < s->ran && meets(p, nnow, now))
+		return false;
+
+	if(n->undone > s->ran && meets(p, seen, now))
+		return false;
+
+	return true;
+}
+
+/*  Whether the run on stripe s is the one stepping in raster order would
+*   have given, with every stripe above it already settled. The first
+*   stripe goes before the last one, the last one after the first.
+*/
+static bool settled(struct speculation *p, struct slice *s)
+{
+	struct slice *a = above(p, s), *b = below(p, s);
+
+	if(s->k.broken)
+		return false;
+
+	if(s != p->slices) {
+		if(!after(p, a, &a->seen[1], s, &s->now[0]))
+			return false;
+	} else if(!before(p, a, &a->now[1], &a->seen[1], s, &s->now[0])) {
+		return false;
+	}
+
+	if(b == p->slices)
+		return after(p, b, &b->seen[0], s, &s->now[1]);
+
+	return before(p, b, &b->now[0], &b->seen[0], s, &s->now[1]);
+}
+
+/*  Top to bottom, every stripe's run gets checked against the settled ones
+*   above it and whatever's there below it. A run that doesn't hold up is
+*   rolled back and redone alone, and the one below goes too if it got in
+*   the way, it's redone when its turn comes. Redoing a run with everything
+*   above settled and nothing below in the way always holds up, so each
+*   stripe takes a few goes at most.
+*/
+static void sweep(struct speculation *p)
+{
+	for(unsigned int j = 0; j < p->count; j++) {
+		struct slice *s = &p->slices[j];
+		struct slice *a = above(p, s), *b = below(p, s);
+
+		for(;;) {
+			if(s->ran == 0) {
+				run(p, s, p->clock++, true);
+				p->runs++;
+			}
+
+			if(settled(p, s))
+				break;
+
+			undo(p, s);
+			if(j + 1 < p->count && b->ran &&
+				meets(p, &b->now[0], &s->now[1]))
+				undo(p, b);
+			if(j == 0 && a->ran && meets(p, &a->now[1], &s->now[0]))
+				undo(p, a);
+		}
+	}
+}
+
+/* the cells at the start of the step near the edges, see struct slice */
+static void mark_base(struct speculation *p, struct slice *s)
+{
+	struct world *w = p->w;
+	const uint32_t rows[2][2] = {
+		{ s->top, s->top + SEAM + 1 },
+		{ s->bottom - SEAM - 1, s->bottom }
+	};
+
+	for(int z = 0; z < 2; z++) {
+		memset(s->base[z], 0, p->seam_words * sizeof(uint64_t));
+		memset(s->seen[z].reads, 0, p->seam_words * sizeof(uint64_t));
+		memset(s->seen[z].writes, 0, p->seam_words * sizeof(uint64_t));
+		s->seen[z].spilled = false;
+	}
+
+	for(int r = 0; r < 2; r++) {
+		for(uint32_t y = rows[r][0]; y < rows[r][1]; y++) {
+			for(uint32_t x = 0; x < w->length; x++) {
+				size_t i = INDEX_WORLD(*w, x, y);
+
+				if(IS_ALIVE(w, i) &&
+					!cell_asleep(w, TILE_HANDLE(w, i)))
+					mark(w, p, s, s->base, x, y);
+			}
+		}
+	}
+}
+
+/* the stripes of a colour, whichever ones nobody else took yet */
+static void run_colour(struct speculation *p)
+{
+	unsigned int j;
+
+	while((j = __atomic_fetch_add(&p->next, 1, __ATOMIC_RELAXED)) <
+		p->count / 2)
+		run(p, &p->slices[2 * j + p->colour], p->colour + 1, false);
+}
+
+static void *work(void *arg)
+{
+	struct speculation *p = arg;
+
+	for(;;) {
+		pthread_barrier_wait(&p->barrier);
+		if(p->quit)
+			break;
+
+		run_colour(p);
+		pthread_barrier_wait(&p->barrier);
+	}
+
+	return NULL;
+}
+
+static struct speculation *start_speculation(struct world *w)
+{
+	struct speculation *p = calloc(1, sizeof(*p));
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	/* the same stripes as STEP_STRIPES, off the size of the world only */
+	unsigned int tall = 2 * STEP_REACH + 1 +
+		(256 + w->stride - 1) / w->stride;
+
+	die(p == NULL, "Couldn't allocate the speculation");
+
+	p->w = w;
+	p->threads = w->threads ? w->threads : cpus > 0 ? cpus : 1;
+	p->count = w->height / tall;
+	if(p->count > MAX_SLICES)
+		p->count = MAX_SLICES;
+	p->count &= ~1u;
+
+	if(p->count < 4) {
+		p->count = 0;
+		return p;
+	}
+
+	p->row_words = (w->length + 63) / 64;
+	p->seam_words = 2 * SEAM * p->row_words;
+	p->slices = aligned_alloc(64, p->count * sizeof(*p->slices));
+	die(p->slices == NULL, "Couldn't allocate the speculation");
+	memset(p->slices, 0, p->count * sizeof(*p->slices));
+
+	for(unsigned int j = 0; j < p->count; j++) {
+		struct slice *s = &p->slices[j];
+		uint64_t *bits = calloc(10 * p->seam_words, sizeof(uint64_t));
+
+		die(bits == NULL, "Couldn't allocate the speculation");
+
+		s->k.slice = s;
+		s->top = (uint64_t)j * w->height / p->count;
+		s->bottom = (uint64_t)(j + 1) * w->height / p->count;
+
+		for(int z = 0; z < 2; z++) {
+			s->base[z] = bits;
+			s->now[z].reads   = bits + 1 * p->seam_words;
+			s->now[z].writes  = bits + 2 * p->seam_words;
+			s->seen[z].reads  = bits + 3 * p->seam_words;
+			s->seen[z].writes = bits + 4 * p->seam_words;
+			bits += 5 * p->seam_words;
+		}
+	}
+
+	if(p->threads > 1) {
+		p->pool = malloc(p->threads * sizeof(*p->pool));
+		die(p->pool == NULL, "Couldn't allocate the speculation");
+
+		pthread_barrier_init(&p->barrier, NULL, p->threads);
+		for(unsigned int i = 1; i < p->threads; i++)
+			die(pthread_create(&p->pool[i], NULL, work, p) != 0,
+				"Couldn't start a thread");
+	}
+
+	return p;
+}
+
+void free_speculation(struct world *w)
+{
+	struct speculation *p = w->speculation;
+
+	if(p == NULL)
+		return;
+
+	if(p->pool) {
+		p->quit = true;
+		pthread_barrier_wait(&p->barrier);
+		for(unsigned int i = 1; i < p->threads; i++)
+			pthread_join(p->pool[i], NULL);
+		pthread_barrier_destroy(&p->barrier);
+	}
+
+	for(unsigned int j = 0; j < p->count; j++) {
+		struct slice *s = &p->slices[j];
+
+		free(s->base[0]);
+		free(s->k.births);
+		free(s->k.freed);
+		free(s->k.undo);
+	}
+
+	free(p->slices);
+	free(p->pool);
+	free(p);
+	w->speculation = NULL;
+}
+
+void speculation_counts(const struct world *w, uint64_t *runs,
+	uint64_t *redone)
+{
+	const struct speculation *p = w->speculation;
+
+	*runs = p ? p->runs : 0;
+	*redone = p ? p->redone : 0;
+}
+
+bool step_speculate(struct world *w, struct statistics *stats)
+{
+	struct speculation *p = w->speculation;
+
+	if(p == NULL)
+		p = w->speculation = start_speculation(w);
+	if(p->count == 0)
+		return false;
+
+	/* children of a parallel run can be new species, both of them */
+	genome_reserve(&w->genomes, 2 * WORKER_SLOTS * p->count);
+	for(unsigned int j = 0; j < p->count; j++) {
+		struct slice *s = &p->slices[j];
+
+		world_reserve_slots(w, &s->k, WORKER_SLOTS);
+		s->ran = s->first = s->undone = 0;
+	}
+
+	if(p->threads == 1) {
+		/* nothing to speculate on, in order it is */
+		for(unsigned int j = 0; j < p->count; j++)
+			run(p, &p->slices[j], j + 1, true);
+		p->runs += p->count;
+	} else {
+		for(unsigned int j = 0; j < p->count; j++)
+			mark_base(p, &p->slices[j]);
+
+		/* evens, then odds, the calling thread pitches in */
+		for(unsigned int colour = 0; colour < 2; colour++) {
+			p->colour = colour;
+			p->next = 0;
+
+			pthread_barrier_wait(&p->barrier);
+			run_colour(p);
+			pthread_barrier_wait(&p->barrier);
+		}
+
+		p->runs += p->count;
+		p->clock = 3;
+		sweep(p);
+	}
+
+	/* everything holds up, in order, so the slots come out the same */
+	for(unsigned int j = 0; j < p->count; j++) {
+		struct worker *k = &p->slices[j].k;
+
+		world_commit(w, k);
+		world_return_slots(w, k);
+
+		w->census.cells       += k->census.cells;
+		w->census.dead        += k->census.dead;
+		w->census.cell_energy += k->census.cell_energy;
+		w->census.dead_energy += k->census.dead_energy;
+
+		stats->death   += k->stats.death;
+		stats->old_age += k->stats.old_age;
+		stats->murder  += k->stats.murder;
+		stats->starve  += k->stats.starve;
+		stats->suicide += k->stats.suicide;
+		stats->births  += k->stats.births;
+
+		ZERO_STRUCT(k->census);
+		ZERO_STRUCT(k->stats);
+	}
+
+	world_recount_free(w);
+	return true;
+}
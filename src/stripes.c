@@ -0,0 +1,352 @@
+/*  SPDX-License-Identifier: GPL-3.0-only
+*   Cellular life simulation following strict rules
+*   Copyright (C) 2023 Teresa Maria Rivera
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "include/world.h"
+#include "include/util.h"
+
+_Thread_local struct worker *this_worker;
+
+/*  STEP_STRIPES cuts the world into an even number of stripes of whole rows
+*   and steps them in two colours, every even stripe at once, then every odd
+*   one. Nothing a cell does in a step reaches more than STEP_REACH rows
+*   out of its stripe, so with stripes taller than twice that, stripes of
+*   the same colour never touch the same tiles, or the same words of the
+*   bitplanes. The one in between is left alone until the next colour.
+*
+*   Whatever can't be cut up like that waits until the threads are done
+*   with a colour: the slots of the cells that died, which go back on the
+*   pool's free list, and children past the few slots each stripe gets set
+*   aside. The calling thread sorts those out on its own, stripe by stripe.
+*   The free tile counts get rebuilt at the end of the step.
+*
+*   Each stripe keeps its own worker, the cells roll their own dice, and
+*   how many stripes there are only goes by the size of the world, so how
+*   many threads there are and which one takes which stripe doesn't change
+*   a thing. One thread just steps them one after the other.
+*/
+
+/* at most this many stripes, more only costs more sorting and settling */
+#define MAX_STRIPES 64
+
+struct worker_thread {
+	struct stripes *s;
+	pthread_t thread;
+};
+
+struct stripes {
+	struct world *w;
+	unsigned int threads; /* including the one calling step_world */
+	unsigned int count;   /* of stripes, even, 0 if the world is too small */
+	uint32_t *stripe_of;  /* stripe of each padded row */
+
+	/* live cells by stripe, stripe j's start at start[j] */
+	uint32_t *start;
+	uint32_t *cells;
+	uint32_t cells_capacity;
+
+	struct worker *workers;   /* one per stripe */
+	struct worker_thread *pool;
+	pthread_barrier_t barrier;
+
+	unsigned int colour;
+	unsigned int next; /* next stripe of the colour up for grabs */
+	bool quit;
+};
+
+void worker_defer_birth(struct world *w, struct worker *k, uint32_t parent,
+	size_t n)
+{
+	struct birth *b;
+
+	/* nowhere to put the child, same as give_birth */
+	if(TILE_TYPE(w, n) == 2)
+		return;
+
+	if(unlikely(k->n_births == k->births_capacity)) {
+		k->births_capacity = k->births_capacity ?
+			2 * k->births_capacity : 64;
+		k->births = realloc(k->births,
+			k->births_capacity * sizeof(*k->births));
+		die(k->births == NULL, "Couldn't grow a worker's births");
+	}
+
+	b = &k->births[k->n_births++];
+	b->parent = parent;
+	b->tile = n;
+	b->mutated = conceive_child(w, parent, n, &b->child, b->parent_genes);
+}
+
+void worker_defer_free(struct worker *k, uint32_t h)
+{
+	if(unlikely(k->n_freed == k->freed_capacity)) {
+		k->freed_capacity = k->freed_capacity ?
+			2 * k->freed_capacity : 64;
+		k->freed = realloc(k->freed,
+			k->freed_capacity * sizeof(*k->freed));
+		die(k->freed == NULL, "Couldn't grow a worker's freed slots");
+	}
+
+	k->freed[k->n_freed++] = h;
+}
+
+/* the stripes of a colour, whichever ones nobody else took yet */
+static void step_colour(struct stripes *s)
+{
+	struct world *w = s->w;
+	unsigned int j;
+
+	while((j = __atomic_fetch_add(&s->next, 1, __ATOMIC_RELAXED)) <
+		s->count / 2) {
+		unsigned int stripe = 2 * j + s->colour;
+		struct worker *k = &s->workers[stripe];
+
+		this_worker = k;
+
+		for(uint32_t i = s->start[stripe]; i < s->start[stripe + 1];
+			i++) {
+			uint32_t h = s->cells[i], t = CELL_TILE(w, h), y;
+
+			/*  died, or moved off, then it's been updated already
+			*   (or the slot went to a child, that can wait)
+			*/
+			if(t & POOL_FREE)
+				continue;
+
+			y = world_row(w, t);
+			if(s->stripe_of[y] != stripe)
+				continue;
+
+			step_cell(w, &k->stats, t - y * w->stride - 1, y - 1);
+		}
+	}
+
+	this_worker = NULL;
+}
+
+static void *work(void *arg)
+{
+	struct worker_thread *t = arg;
+	struct stripes *s = t->s;
+
+	for(;;) {
+		pthread_barrier_wait(&s->barrier);
+		if(s->quit)
+			break;
+
+		step_colour(s);
+		pthread_barrier_wait(&s->barrier);
+	}
+
+	return NULL;
+}
+
+static struct stripes *start_stripes(struct world *w)
+{
+	struct stripes *s = calloc(1, sizeof(*s));
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	/* two reaches and the words of bits at either end between them */
+	unsigned int tall = 2 * STEP_REACH + 1 +
+		(256 + w->stride - 1) / w->stride;
+
+	die(s == NULL, "Couldn't allocate the stripes");
+
+	s->w = w;
+	s->threads = w->threads ? w->threads : cpus > 0 ? cpus : 1;
+	s->count = w->height / tall;
+	if(s->count > MAX_STRIPES)
+		s->count = MAX_STRIPES;
+	s->count &= ~1u;
+
+	/* too small to have two stripes going at once */
+	if(s->count < 4) {
+		s->count = 0;
+		return s;
+	}
+
+	s->stripe_of = malloc((w->height + 2) * sizeof(*s->stripe_of));
+	s->start     = malloc((s->count + 1) * sizeof(*s->start));
+	s->workers   = aligned_alloc(64, s->count * sizeof(*s->workers));
+	s->pool      = malloc(s->threads * sizeof(*s->pool));
+	die(s->stripe_of == NULL || s->start == NULL ||
+		s->workers == NULL || s->pool == NULL,
+		"Couldn't allocate the stripes");
+
+	memset(s->workers, 0, s->count * sizeof(*s->workers));
+	for(unsigned int j = 0; j < s->count; j++)
+		for(uint32_t y = (uint64_t)j * w->height / s->count;
+			y < (uint64_t)(j + 1) * w->height / s->count; y++)
+			s->stripe_of[y + 1] = j;
+
+	/* the ghost rows never have a cell on them */
+	s->stripe_of[0] = s->stripe_of[w->height + 1] = s->count;
+
+	pthread_barrier_init(&s->barrier, NULL, s->threads);
+	for(unsigned int i = 0; i < s->threads; i++) {
+		s->pool[i].s = s;
+		if(i)
+			die(pthread_create(&s->pool[i].thread, NULL, work,
+				&s->pool[i]) != 0, "Couldn't start a thread");
+	}
+
+	return s;
+}
+
+void free_stripes(struct world *w)
+{
+	struct stripes *s = w->stripes;
+
+	if(s == NULL)
+		return;
+
+	if(s->count) {
+		s->quit = true;
+		pthread_barrier_wait(&s->barrier);
+		for(unsigned int i = 1; i < s->threads; i++)
+			pthread_join(s->pool[i].thread, NULL);
+		pthread_barrier_destroy(&s->barrier);
+
+		for(unsigned int j = 0; j < s->count; j++) {
+			free(s->workers[j].births);
+			free(s->workers[j].freed);
+		}
+	}
+
+	free(s->stripe_of);
+	free(s->start);
+	free(s->cells);
+	free(s->workers);
+	free(s->pool);
+	free(s);
+	w->stripes = NULL;
+}
+
+/* counting sort of the cells that need stepping, by stripe */
+static void sort_cells(struct stripes *s)
+{
+	struct world *w = s->w;
+
+	if(unlikely(s->cells_capacity < w->pool.count)) {
+		s->cells_capacity = w->pool.capacity;
+		free(s->cells);
+		s->cells = malloc(s->cells_capacity * sizeof(*s->cells));
+		die(s->cells == NULL, "Couldn't grow the stripes");
+	}
+
+	memset(s->start, 0, (s->count + 1) * sizeof(*s->start));
+	for(uint32_t h = 0; h < w->pool.top; h++) {
+		uint32_t t = CELL_TILE(w, h);
+
+		if(!(t & POOL_FREE) && !cell_asleep(w, h))
+			s->start[s->stripe_of[world_row(w, t)] + 1]++;
+	}
+
+	for(unsigned int j = 0; j < s->count; j++)
+		s->start[j + 1] += s->start[j];
+
+	/* start[j] ends up where stripe j + 1 starts, shift them back after */
+	for(uint32_t h = 0; h < w->pool.top; h++) {
+		uint32_t t = CELL_TILE(w, h);
+
+		if(!(t & POOL_FREE) && !cell_asleep(w, h))
+			s->cells[s->start[s->stripe_of[world_row(w, t)]]++] = h;
+	}
+
+	memmove(s->start + 1, s->start, s->count * sizeof(*s->start));
+	s->start[0] = 0;
+}
+
+/*  births first, the slots freed this colour can't go to the children, and
+*   in stripe order, whoever stepped them. These are the ones past the
+*   stripe's own slots, paid for when they were asked for, with the energy
+*   the parent had then, all that's left is a slot. Somebody on the stripe
+*   stepped after the parent can have moved into the nursery in the
+*   meantime, then the child's lost.
+*/
+static void settle(struct stripes *s)
+{
+	struct world *w = s->w;
+
+	for(unsigned int j = s->colour; j < s->count; j += 2) {
+		struct worker *k = &s->workers[j];
+
+		world_return_slots(w, k);
+		for(uint32_t i = 0; i < k->n_births; i++) {
+			struct birth *b = &k->births[i];
+
+			if(TILE_TYPE(w, b->tile) != 2)
+				deliver_child(w, &k->stats, b->parent, b->tile,
+					&b->child, b->parent_genes, b->mutated);
+		}
+		k->n_births = 0;
+	}
+
+	for(unsigned int j = s->colour; j < s->count; j += 2) {
+		struct worker *k = &s->workers[j];
+
+		for(uint32_t f = 0; f < k->n_freed; f++)
+			world_release_cell(w, k->freed[f]);
+		k->n_freed = 0;
+	}
+}
+
+bool step_stripes(struct world *w, struct statistics *stats)
+{
+	struct stripes *s = w->stripes;
+
+	if(s == NULL)
+		s = w->stripes = start_stripes(w);
+	if(s->count == 0)
+		return false;
+
+	sort_cells(s);
+
+	for(unsigned int colour = 0; colour < 2; colour++) {
+		s->colour = colour;
+		s->next = 0;
+
+		/* children of a colour can be new species, both of them */
+		genome_reserve(&w->genomes, WORKER_SLOTS * s->count);
+		for(unsigned int j = colour; j < s->count; j += 2)
+			world_reserve_slots(w, &s->workers[j], WORKER_SLOTS);
+
+		/* the calling thread pitches in */
+		pthread_barrier_wait(&s->barrier);
+		step_colour(s);
+		pthread_barrier_wait(&s->barrier);
+
+		settle(s);
+	}
+
+	world_recount_free(w);
+
+	/* the changes wrap around just like the totals do, it adds up */
+	for(unsigned int j = 0; j < s->count; j++) {
+		struct worker *k = &s->workers[j];
+
+		w->census.cells       += k->census.cells;
+		w->census.dead        += k->census.dead;
+		w->census.cell_energy += k->census.cell_energy;
+		w->census.dead_energy += k->census.dead_energy;
+
+		stats->death   += k->stats.death;
+		stats->old_age += k->stats.old_age;
+		stats->murder  += k->stats.murder;
+		stats->starve  += k->stats.starve;
+		stats->suicide += k->stats.suicide;
+		stats->births  += k->stats.births;
+
+		ZERO_STRUCT(k->census);
+		ZERO_STRUCT(k->stats);
+	}
+
+	return true;
+}
@@ -5,86 +5,1415 @@
 
 
 #include <stdint.h>
+#include <inttypes.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <immintrin.h>
+#include <pthread.h>
 #include "include/world.h"
+#include "include/cpu.h"
 #include "include/math.h"
 #include "include/rng.h"
+#include "include/util.h"
 
-extern generator_handle main_rng;
+extern _Thread_local generator_handle main_rng;
 
-static void place_food(struct world *w, uint32_t num) 
+/* the tiles around i need whatever they cache in stale redone */
+static inline void stale_around(struct world *w, size_t i, bool *stale)
 {
-	for(int i = 0; i < num * (w->food_gen_iters/4); i++) {
-		unsigned int ax, ay;
-		struct tile t;
-		ax = gen32(main_rng) % w->length;
-		ay = gen32(main_rng) % w->height;
-		t = INDEX_WORLD((*w), ax, ay);
+	const ptrdiff_t s = w->stride;
+	const ptrdiff_t last = (ptrdiff_t)(w->height + 2) * s - 1;
 
-		switch(t.type) {
-			case 1:
-			case 2:
-			i--;
-			break;
+	/* the row above, this row, and the row below, clipped to the planes */
+	for(ptrdiff_t r = (ptrdiff_t)i - s; r <= (ptrdiff_t)i + s; r += s) {
+		ptrdiff_t lo = r - 1, hi = r + 1;
+
+		if(hi < 0 || lo > last)
+			continue;
+
+		stale[(lo < 0 ? 0 : lo) >> 6] = true;
+		stale[(hi > last ? last : hi) >> 6] = true;
+	}
+}
+
+/* type plane and bitplanes together */
+static inline void write_type(struct world *w, size_t i, uint8_t type)
+{
+	uint8_t old = TILE_TYPE(w, i);
+	uint64_t bit = UINT64_C(1) << (i & 63);
+
+	if(old == type)
+		return;
+
+	TILE_TYPE(w, i) = type;
+
+	if(old == 2 || type == 2) {
+		w->alive_bits[i >> 6] ^= bit;
+		stale_around(w, i, w->nbr_stale);
+	}
+
+	if(old == 1 || type == 1)
+		w->food_bits[i >> 6] ^= bit;
+
+	stale_around(w, i, w->sensors_stale);
+}
+
+/* copy the type of an edge tile into the ghost ring on the opposite side */
+static inline void mirror_tile(struct world *w, size_t i)
+{
+	uint32_t y = world_row(w, i);
+	uint32_t x = i - (size_t)y * w->stride;
+	uint32_t gx = x, gy = y;
+
+	if(likely(x > 1 && x < w->length && y > 1 && y < w->height))
+		return;
+
+	if(x == 1)
+		gx = w->length + 1;
+	else if(x == w->length)
+		gx = 0;
+
+	if(y == 1)
+		gy = w->height + 1;
+	else if(y == w->height)
+		gy = 0;
+
+	if(gx != x)
+		write_type(w, (size_t)y * w->stride + gx, w->type[i]);
+	if(gy != y)
+		write_type(w, (size_t)gy * w->stride + x, w->type[i]);
+	if(gx != x && gy != y)
+		write_type(w, (size_t)gy * w->stride + gx, w->type[i]);
+}
+
+/*  tile i went from free to taken or back, d is +1 or -1, threads stepping
+*   stripes only flip the bit and leave the counts for world_recount_free
+*/
+static inline void toggle_free(struct world *w, size_t i, int32_t d)
+{
+	w->free_bits[i >> 6] ^= UINT64_C(1) << (i & 63);
+	if(this_worker)
+		return;
+
+	w->free_count += d;
+
+	for(size_t b = (i >> 6) / FREE_BLOCK_WORDS + 1; b <= w->free_blocks;
+		b += b & -b)
+		w->free_tree[b] += d;
+}
+
+/*  The journal STEP_SPECULATE keeps for a stripe's run, what everything
+*   the run changed was before it did. Tiles and cells get their old values
+*   saved, births the slot they took and interned genomes the reference,
+*   undo gives those back. Releasing a genome could free it for somebody
+*   else's new species, so that's put off until the run is committed.
+*/
+enum { UNDO_TILE, UNDO_CELL, UNDO_BORN, UNDO_REF, UNDO_DROP };
+
+/* where a child's slot came from, so it can go back exactly there */
+enum { SLOT_OWN, SLOT_FREE, SLOT_TOP };
+
+struct undo {
+	uint8_t kind;
+	union {
+		uint8_t type; /* of the tile */
+		uint8_t slot; /* of the child, SLOT_* */
+	};
+	uint32_t at; /* the tile, slot or genome */
+	union {
+		struct {
+			uint32_t handle;
+			energy_t energy;
+			cell_id_t id;
+		} tile;
+		struct {
+			uint32_t tile;
+			uint32_t genome;
+			uint32_t since;
+			uint32_t deadline;
+			cell_id_t id;
+			energy_t energy;
+			age_t age;
+			oscil_t oscil_dur;
+			oscil_t oscil_ctr;
+			uint8_t compass;
+			uint8_t actions;
+			bool updated;
+		} cell;
+	};
+};
+
+/* interning has to be one thread at a time, the rest only read genomes */
+static pthread_mutex_t genome_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* the worker keeping a journal on this thread, NULL for none */
+static inline struct worker *journaling(void)
+{
+	struct worker *k = this_worker;
+
+	return k != NULL && k->journal ? k : NULL;
+}
+
+static inline struct undo *journal(struct worker *k, uint8_t kind,
+	uint32_t at)
+{
+	struct undo *u;
+
+	if(unlikely(k->n_undo == k->undo_capacity)) {
+		k->undo_capacity = k->undo_capacity ?
+			2 * k->undo_capacity : 1024;
+		k->undo = realloc(k->undo, k->undo_capacity * sizeof(*k->undo));
+		die(k->undo == NULL, "Couldn't grow a journal");
+	}
+
+	u = &k->undo[k->n_undo++];
+	u->kind = kind;
+	u->at = at;
+	return u;
+}
+
+static inline void save_tile(struct world *w, size_t i)
+{
+	struct worker *k = journaling();
+	struct undo *u;
+
+	if(likely(k == NULL))
+		return;
+
+	slice_wrote(w, k->slice, i);
+	u = journal(k, UNDO_TILE, i);
+	u->type        = TILE_TYPE(w, i);
+	u->tile.handle = TILE_HANDLE(w, i);
+	u->tile.energy = TILE_ENERGY(w, i);
+	u->tile.id     = TILE_ID(w, i);
+}
+
+/*  every write to the type plane goes through here, real tiles only, and
+*   whatever else of the tile gets written goes with it
+*/
+static inline void set_type(struct world *w, size_t i, uint8_t type)
+{
+	save_tile(w, i);
+
+	/*  whatever was dead here is gone now, even if it's getting replaced
+	*   by another dead thing
+	*/
+	if(TILE_TYPE(w, i) == 1) {
+		census(w)->dead--;
+		census(w)->dead_energy -= TILE_ENERGY(w, i);
+	}
+
+	if((TILE_TYPE(w, i) == 0) != (type == 0))
+		toggle_free(w, i, type == 0 ? 1 : -1);
+
+	write_type(w, i, type);
+	mirror_tile(w, i);
+}
+
+/* 64 bits of a bitplane starting at bit i, which doesn't need to be aligned
+*  and can go one word under the start thanks to the guard word
+*/
+static inline uint64_t bits_at(const uint64_t *plane, ptrdiff_t i)
+{
+	ptrdiff_t word = i >> 6;
+	unsigned int b = i & 63;
+
+	if(b == 0)
+		return plane[word];
+
+	return (plane[word] >> b) | (plane[word + 1] << (64 - b));
+}
+
+#define HALF_ADD(a, b, sum, carry) { \
+	sum = (a) ^ (b); \
+	carry = (a) & (b); }
+
+#define FULL_ADD(a, b, c, sum, carry) { \
+	uint64_t __t = (a) ^ (b); \
+	sum = __t ^ (c); \
+	carry = ((a) & (b)) | (__t & (c)); }
+
+void world_count_neighbours(struct world *w, size_t k)
+{
+	const ptrdiff_t s = w->stride, i = k * 64;
+	uint64_t n[8], s0, s1, s2, c0, c1, c2, c3, t, d0, d1;
+
+	n[0] = bits_at(w->alive_bits, i - s - 1);
+	n[1] = bits_at(w->alive_bits, i - s);
+	n[2] = bits_at(w->alive_bits, i - s + 1);
+	n[3] = bits_at(w->alive_bits, i - 1);
+	n[4] = bits_at(w->alive_bits, i + 1);
+	n[5] = bits_at(w->alive_bits, i + s - 1);
+	n[6] = bits_at(w->alive_bits, i + s);
+	n[7] = bits_at(w->alive_bits, i + s + 1);
+
+	/*  add up eight 1 bit numbers for all 64 tiles at once,
+	*   the count ends up sliced across four words
+	*/
+	FULL_ADD(n[0], n[1], n[2], s0, c0);
+	FULL_ADD(n[3], n[4], n[5], s1, c1);
+	HALF_ADD(n[6], n[7], s2, c2);
+	FULL_ADD(s0, s1, s2, w->nbr[k][0], c3);
+
+	FULL_ADD(c0, c1, c2, t, d0);
+	HALF_ADD(t, c3, w->nbr[k][1], d1);
+
+	HALF_ADD(d0, d1, w->nbr[k][2], w->nbr[k][3]);
+
+	w->nbr_stale[k] = false;
+}
+
+#undef HALF_ADD
+#undef FULL_ADD
+
+/* spread the bits back out, one tile per lane, bit j of tile b is src[j]'s */
+static void spread_scalar(uint16_t *out, const uint64_t src[12])
+{
+	for(unsigned int b = 0; b < 64; b++) {
+		uint16_t v = 0;
+
+		for(unsigned int j = 0; j < 12; j++)
+			v |= ((src[j] >> b) & 1) << j;
+		out[b] = v;
+	}
+}
+
+/*  16 tiles to a register, a lane is all ones where its bit of the source
+*   word is set, then only bit j of that is kept
+*/
+__attribute__((CPU_TARGET_AVX2))
+static void spread_avx2(uint16_t *out, const uint64_t src[12])
+{
+	const __m256i lane = _mm256_setr_epi16(1 << 0, 1 << 1, 1 << 2,
+		1 << 3, 1 << 4, 1 << 5, 1 << 6, 1 << 7, 1 << 8, 1 << 9,
+		1 << 10, 1 << 11, 1 << 12, 1 << 13, 1 << 14, 1 << 15);
+
+	for(unsigned int q = 0; q < 4; q++) {
+		__m256i v = _mm256_setzero_si256();
+
+		for(unsigned int j = 0; j < 12; j++) {
+			__m256i x = _mm256_set1_epi16(src[j] >> (16 * q));
+
+			x = _mm256_cmpeq_epi16(_mm256_and_si256(x, lane), lane);
+			v = _mm256_or_si256(v, _mm256_and_si256(x,
+				_mm256_set1_epi16(1 << j)));
+		}
+
+		_mm256_storeu_si256((__m256i *)(out + 16 * q), v);
+	}
+}
+
+/*  each source word turns into a mask picking which lanes get its bit,
+*   32 tiles to a register
+*/
+__attribute__((CPU_TARGET_AVX512))
+static void spread_avx512(uint16_t *out, const uint64_t src[12])
+{
+	for(unsigned int h = 0; h < 2; h++) {
+		__m512i v = _mm512_setzero_si512();
+
+		for(unsigned int j = 0; j < 12; j++)
+			v = _mm512_or_si512(v, _mm512_maskz_set1_epi16(
+				src[j] >> (32 * h), 1 << j));
+
+		_mm512_storeu_si512(out + 32 * h, v);
+	}
+}
+
+void world_count_sensors(struct world *w, size_t k)
+{
+	const ptrdiff_t s = w->stride, i = k * 64;
+	uint64_t src[12];
+
+	if(w->nbr_stale[k])
+		world_count_neighbours(w, k);
+
+	/* in the order of the bits of a sensor word */
+	src[0]  = bits_at(w->food_bits, i + s);
+	src[1]  = bits_at(w->food_bits, i - s);
+	src[2]  = bits_at(w->food_bits, i - 1);
+	src[3]  = bits_at(w->food_bits, i + 1);
+	src[4]  = bits_at(w->alive_bits, i + s);
+	src[5]  = bits_at(w->alive_bits, i - s);
+	src[6]  = bits_at(w->alive_bits, i - 1);
+	src[7]  = bits_at(w->alive_bits, i + 1);
+	src[8]  = w->nbr[k][0];
+	src[9]  = w->nbr[k][1];
+	src[10] = w->nbr[k][2];
+	src[11] = w->nbr[k][3];
+
+	switch(cpu_level()) {
+		case CPU_AVX512:
+		spread_avx512(&w->sensors[i], src);
+		break;
+
+		case CPU_AVX2:
+		spread_avx2(&w->sensors[i], src);
+		break;
+
+		default:
+		spread_scalar(&w->sensors[i], src);
+		break;
+	}
+
+	w->sensors_stale[k] = false;
+}
+
+static void pool_grow(struct cell_pool *p, uint32_t capacity)
+{
+	p->capacity  = capacity;
+	p->tile      = realloc(p->tile, capacity * sizeof(*p->tile));
+	p->id        = realloc(p->id, capacity * sizeof(*p->id));
+	p->energy    = realloc(p->energy, capacity * sizeof(*p->energy));
+	p->age       = realloc(p->age, capacity * sizeof(*p->age));
+	p->oscil_dur = realloc(p->oscil_dur, capacity * sizeof(*p->oscil_dur));
+	p->oscil_ctr = realloc(p->oscil_ctr, capacity * sizeof(*p->oscil_ctr));
+	p->genome    = realloc(p->genome, capacity * sizeof(*p->genome));
+	p->actions   = realloc(p->actions, capacity * sizeof(*p->actions));
+	p->since     = realloc(p->since, capacity * sizeof(*p->since));
+	p->deadline  = realloc(p->deadline, capacity * sizeof(*p->deadline));
+#ifdef CELLS_COMPACT
+	p->flags     = realloc(p->flags, capacity * sizeof(*p->flags));
+
+	die(p->flags == NULL, "Couldn't grow the cell pool");
+#else
+	p->compass   = realloc(p->compass, capacity * sizeof(*p->compass));
+	p->updated   = realloc(p->updated, capacity * sizeof(*p->updated));
 
-			default:
-			t.type = 1;
-			t.dead.id = gen64(main_rng);
-			t.dead.energy = isqrt(gen32(main_rng));
+	die(p->compass == NULL || p->updated == NULL,
+		"Couldn't grow the cell pool");
+#endif
+
+	die(p->tile == NULL || p->id == NULL || p->energy == NULL ||
+		p->age == NULL || p->oscil_dur == NULL ||
+		p->oscil_ctr == NULL || p->genome == NULL || p->actions == NULL ||
+		p->since == NULL || p->deadline == NULL,
+		"Couldn't grow the cell pool");
+}
+
+static inline uint32_t pool_alloc(struct cell_pool *p)
+{
+	uint32_t h;
+
+	p->count++;
+	if(p->free != POOL_END) {
+		h = p->free;
+		p->free = p->tile[h] & ~POOL_FREE;
+		return h;
+	}
+
+	if(unlikely(p->top == p->capacity))
+		pool_grow(p, p->capacity * 2);
+
+	return p->top++;
+}
+
+static inline void pool_free(struct cell_pool *p, uint32_t h)
+{
+	p->count--;
+	p->tile[h] = p->free | POOL_FREE;
+	p->free = h;
+}
+
+/*  a slot for a child, out of the worker's own on a stripe, so who gets
+*   which slot doesn't depend on which stripe got there first
+*/
+static inline uint32_t take_slot(struct world *w)
+{
+	struct worker *k = this_worker;
+	struct undo *u;
+	uint8_t slot;
+	uint32_t h;
+
+	if(likely(k == NULL))
+		return pool_alloc(&w->pool);
+
+	if(k->used_slots < k->n_slots) {
+		slot = SLOT_OWN;
+		h = k->slots[k->used_slots++];
+	} else {
+		slot = w->pool.free == POOL_END ? SLOT_TOP : SLOT_FREE;
+		h = pool_alloc(&w->pool);
+	}
+
+	if(k->journal) {
+		u = journal(k, UNDO_BORN, h);
+		u->slot = slot;
+	}
+
+	return h;
+}
+
+void world_reserve_slots(struct world *w, struct worker *k, uint8_t n)
+{
+	for(uint8_t i = 0; i < n; i++) {
+		k->slots[i] = pool_alloc(&w->pool);
+		CELL_TILE(w, k->slots[i]) = POOL_FREE | POOL_END;
+	}
+
+	k->n_slots = n;
+	k->used_slots = 0;
+}
+
+/* backwards, the pool's free list ends up the way it was without them */
+void world_return_slots(struct world *w, struct worker *k)
+{
+	while(k->n_slots > k->used_slots)
+		pool_free(&w->pool, k->slots[--k->n_slots]);
+
+	k->n_slots = k->used_slots = 0;
+}
+
+uint32_t world_intern_genome(struct world *w, const gene_t genes[4])
+{
+	struct worker *k = journaling();
+	uint32_t g;
+
+	if(likely(this_worker == NULL))
+		return genome_intern(&w->genomes, genes);
+
+	pthread_mutex_lock(&genome_lock);
+	g = genome_intern(&w->genomes, genes);
+	pthread_mutex_unlock(&genome_lock);
+
+	if(k != NULL)
+		journal(k, UNDO_REF, g);
+	return g;
+}
+
+/* a run that might be undone can't let go of anything yet */
+void world_drop_genome(struct world *w, uint32_t g)
+{
+	struct worker *k = journaling();
+
+	if(likely(this_worker == NULL)) {
+		genome_release(&w->genomes, g);
+	} else if(k == NULL) {
+		pthread_mutex_lock(&genome_lock);
+		genome_release(&w->genomes, g);
+		pthread_mutex_unlock(&genome_lock);
+	} else {
+		journal(k, UNDO_DROP, g);
+	}
+}
+
+void world_release_cell(struct world *w, uint32_t h)
+{
+	genome_release(&w->genomes, CELL_GENOME(w, h));
+	pool_free(&w->pool, h);
+}
+
+/* pool_free and take the cell out of the census */
+static inline void free_cell(struct world *w, uint32_t h)
+{
+	census(w)->cells--;
+	census(w)->cell_energy -= CELL_ENERGY(w, h);
+
+	if(this_worker) {
+		worker_defer_free(this_worker, h);
+		CELL_TILE(w, h) = POOL_FREE | POOL_END;
+		return;
+	}
+
+	world_release_cell(w, h);
+}
+
+/* a dead thing was just put on tile i */
+static inline void count_dead(struct world *w, size_t i)
+{
+	census(w)->dead++;
+	census(w)->dead_energy += TILE_ENERGY(w, i);
+}
+
+/* index of the n'th set bit of x, there has to be one */
+static inline unsigned int select_bit(uint64_t x, unsigned int n)
+{
+	while(n--)
+		x &= x - 1;
+	return __builtin_ctzll(x);
+}
+
+/* the same in one go, deposit a single bit at the n'th set one */
+__attribute__((CPU_TARGET_AVX2))
+static inline unsigned int select_bit_bmi2(uint64_t x, unsigned int n)
+{
+	return __builtin_ctzll(_pdep_u64(UINT64_C(1) << n, x));
+}
+
+/*  The word of the free bits holding the n'th free tile, n ends up which
+*   of its set bits that is. Inlined into each level below, so it gets
+*   POPCNT and LZCNT where they're there.
+*/
+__attribute__((__always_inline__))
+static inline size_t free_word(struct world *w, size_t *np)
+{
+	size_t b = 0, k, n = *np;
+
+	/* down the tree to the block holding it */
+	for(size_t step = (size_t)1 << (63 - __builtin_clzll(w->free_blocks));
+		step; step >>= 1) {
+		if(b + step <= w->free_blocks && w->free_tree[b + step] <= n) {
+			b += step;
+			n -= w->free_tree[b];
+		}
+	}
+
+	/* then popcount through the block */
+	for(k = b * FREE_BLOCK_WORDS; ; k++) {
+		unsigned int c = __builtin_popcountll(w->free_bits[k]);
+		if(n < c)
 			break;
+		n -= c;
+	}
+
+	*np = n;
+	return k;
+}
+
+__attribute__((__noinline__))
+static size_t select_free_scalar(struct world *w, size_t n)
+{
+	size_t k = free_word(w, &n);
+
+	return k * 64 + select_bit(w->free_bits[k], n);
+}
+
+__attribute__((__noinline__, CPU_TARGET_SSE42))
+static size_t select_free_sse42(struct world *w, size_t n)
+{
+	size_t k = free_word(w, &n);
+
+	return k * 64 + select_bit(w->free_bits[k], n);
+}
+
+__attribute__((__noinline__, CPU_TARGET_AVX2))
+static size_t select_free_avx2(struct world *w, size_t n)
+{
+	size_t k = free_word(w, &n);
+
+	return k * 64 + select_bit_bmi2(w->free_bits[k], n);
+}
+
+/* the n'th free tile, counting from 0 in flat index order */
+static size_t select_free(struct world *w, size_t n)
+{
+	switch(cpu_level()) {
+		case CPU_AVX512:
+		case CPU_AVX2:
+		return select_free_avx2(w, n);
+
+		case CPU_SSE42:
+		return select_free_sse42(w, n);
+
+		default:
+		return select_free_scalar(w, n);
+	}
+}
+
+size_t world_random_free(struct world *w)
+{
+	if(unlikely(w->free_count == 0))
+		return NO_TILE;
+
+	return select_free(w, gen64(main_rng) % w->free_count);
+}
+
+size_t world_place_food(struct world *w, size_t n)
+{
+	size_t i;
+
+	for(i = 0; i < n && w->free_count; i++) {
+		size_t t = world_random_free(w);
+
+		set_type(w, t, 1);
+		TILE_ID(w, t) = gen64(main_rng);
+		TILE_ENERGY(w, t) = isqrt(gen32(main_rng));
+		count_dead(w, t);
+	}
+
+	return i;
+}
+
+static void place_food(struct world *w, uint32_t num)
+{
+	world_place_food(w, (size_t)num * (w->food_gen_iters/4));
+}
+
+/* every real tile starts out free */
+static void init_free(struct world *w)
+{
+	size_t words = w->free_blocks * FREE_BLOCK_WORDS;
+
+	w->free_bits = calloc(words, sizeof(*w->free_bits));
+	w->free_tree = calloc(w->free_blocks + 1, sizeof(*w->free_tree));
+	die(w->free_bits == NULL || w->free_tree == NULL,
+		"Couldn't allocate the world");
+
+	for(size_t y = 1; y <= w->height; y++)
+		for(size_t x = 1; x <= w->length; x++) {
+			size_t i = y * w->stride + x;
+			w->free_bits[i >> 6] |= UINT64_C(1) << (i & 63);
 		}
+
+	world_recount_free(w);
+}
+
+__attribute__((__always_inline__))
+static inline void recount_free(struct world *w)
+{
+	memset(w->free_tree, 0, (w->free_blocks + 1) * sizeof(*w->free_tree));
+	w->free_count = 0;
+
+	/* build the tree bottom up, each node pushes its sum to its parent */
+	for(size_t b = 1; b <= w->free_blocks; b++) {
+		size_t p = b + (b & -b);
+		uint32_t n = 0;
+
+		for(size_t k = 0; k < FREE_BLOCK_WORDS; k++)
+			n += __builtin_popcountll(
+				w->free_bits[(b - 1) * FREE_BLOCK_WORDS + k]);
+
+		w->free_tree[b] += n;
+		w->free_count += n;
+		if(p <= w->free_blocks)
+			w->free_tree[p] += w->free_tree[b];
 	}
 }
 
+/* nothing past POPCNT helps a popcount of a few words */
+#define RECOUNT_FREE(name, ...) \
+__attribute__((__noinline__ __VA_OPT__(,) __VA_ARGS__)) \
+static void name(struct world *w) { recount_free(w); }
+
+RECOUNT_FREE(recount_free_scalar)
+RECOUNT_FREE(recount_free_sse42, CPU_TARGET_SSE42)
+
+#undef RECOUNT_FREE
+
+void world_recount_free(struct world *w)
+{
+	if(cpu_level() >= CPU_SSE42)
+		recount_free_sse42(w);
+	else
+		recount_free_scalar(w);
+}
+
 void init_world(struct world *w, unsigned int x, unsigned int y,
 	unsigned int it, unsigned int c)
 {
+	size_t area = (size_t)(x + 2) * (y + 2);
 	c  = c ? c : isqrt((x*y))/8;
 	it = (it > 4) ? it : 4 ;
 	w->height = y;
 	w->length = x;
+	w->stride = x + 2;
+	w->stride_magic = UINT64_MAX / w->stride + 1;
+
+	w->forward[0]             = 0;
+	w->forward[NORTH]         = OFFSET_NORTH(*w);
+	w->forward[SOUTH]         = OFFSET_SOUTH(*w);
+	w->forward[EAST]          = OFFSET_EAST(*w);
+	w->forward[WEST]          = OFFSET_WEST(*w);
+
 	w->iters  = 0;
 	w->food_gen_iters = it;
-	w->grid = calloc(x * y, sizeof(struct tile));
-
-	for(int i = 0; i < c; i++) {
-		unsigned int ax, ay;
-		struct tile t;
-		ax = gen32(main_rng) % x;
-		ay = gen32(main_rng) % y;
-		t = INDEX_WORLD((*w), ax, ay);
-
-		switch(t.type) {
-			case 1:
-			case 2:
-			i--;
+
+	w->type      = calloc(area, sizeof(*w->type));
+	w->handle    = calloc(area, sizeof(*w->handle));
+	w->energy    = calloc(area, sizeof(*w->energy));
+	w->parity    = false;
+	w->step_mode = STEP_DENSE;
+	w->order     = ORDER_RASTER;
+	w->gene_mode = GENES_DECODED;
+	w->dormancy  = true;
+	w->dying     = NULL;
+	w->dying_capacity = 0;
+	w->intents   = NULL;
+	w->intent_order = NULL;
+	w->intents_capacity = 0;
+	w->claims    = NULL;
+	w->threads   = 0;
+	w->stripes   = NULL;
+	w->speculation = NULL;
+
+	die(w->type == NULL || w->handle == NULL || w->energy == NULL,
+		"Couldn't allocate the world");
+
+	/* a guard word on both sides, neighbours can poke a word past */
+	w->bit_words = (area + 63) / 64 + 2;
+	w->alive_bits = calloc(w->bit_words + 2, sizeof(uint64_t));
+	w->food_bits  = calloc(w->bit_words + 2, sizeof(uint64_t));
+	w->nbr        = malloc(w->bit_words * sizeof(*w->nbr));
+	w->nbr_stale  = malloc(w->bit_words * sizeof(*w->nbr_stale));
+	w->sensors    = malloc(w->bit_words * 64 * sizeof(*w->sensors));
+	w->sensors_stale = malloc(w->bit_words * sizeof(*w->sensors_stale));
+
+	die(w->alive_bits == NULL || w->food_bits == NULL ||
+		w->nbr == NULL || w->nbr_stale == NULL ||
+		w->sensors == NULL || w->sensors_stale == NULL,
+		"Couldn't allocate the world");
+
+	w->alive_bits++;
+	w->food_bits++;
+	memset(w->nbr_stale, true, w->bit_words * sizeof(*w->nbr_stale));
+	memset(w->sensors_stale, true,
+		w->bit_words * sizeof(*w->sensors_stale));
+
+	w->free_blocks = (w->bit_words + FREE_BLOCK_WORDS - 1) / FREE_BLOCK_WORDS;
+	init_free(w);
+
+#ifndef CELLS_COMPACT
+	w->id        = calloc(area, sizeof(*w->id));
+	die(w->id == NULL, "Couldn't allocate the world");
+#endif
+
+	ZERO_STRUCT(w->census);
+	ZERO_STRUCT(w->pool);
+	w->pool.free = POOL_END;
+	pool_grow(&w->pool, c > 64 ? c : 64);
+	genome_init(&w->genomes, c > 64 ? c : 64);
+
+	/* no more cells than there are tiles */
+	for(unsigned int i = 0; i < c && w->free_count; i++) {
+		struct cell cell;
+		gen_random_cell(&cell, main_rng);
+		world_store_cell(w, world_random_free(w), &cell);
+	}
+
+	place_food(w, c/4);
+}
+
+void free_world(struct world *w)
+{
+	free_stripes(w);
+	free_speculation(w);
+
+	free(w->type);
+	free(w->handle);
+	free(w->energy);
+	free(w->alive_bits - 1);
+	free(w->food_bits - 1);
+	free(w->nbr);
+	free(w->nbr_stale);
+	free(w->sensors);
+	free(w->sensors_stale);
+	w->sensors = NULL;
+	w->sensors_stale = NULL;
+	free(w->free_bits);
+	free(w->free_tree);
+	w->free_bits = NULL;
+	w->free_tree = NULL;
+	w->alive_bits = NULL;
+	w->food_bits = NULL;
+	w->nbr = NULL;
+	w->nbr_stale = NULL;
+	w->type = NULL;
+	w->handle = NULL;
+	w->energy = NULL;
+#ifndef CELLS_COMPACT
+	free(w->id);
+	w->id = NULL;
+#endif
+
+	free(w->pool.tile);
+	free(w->pool.id);
+	free(w->pool.energy);
+	free(w->pool.age);
+	free(w->pool.oscil_dur);
+	free(w->pool.oscil_ctr);
+	free(w->pool.genome);
+	free(w->pool.actions);
+	free(w->pool.since);
+	free(w->pool.deadline);
+#ifdef CELLS_COMPACT
+	free(w->pool.flags);
+#else
+	free(w->pool.compass);
+	free(w->pool.updated);
+#endif
+	ZERO_STRUCT(w->pool);
+	genome_free_table(&w->genomes);
+
+	free(w->dying);
+	w->dying = NULL;
+	w->dying_capacity = 0;
+
+	free(w->intents);
+	free(w->intent_order);
+	free(w->claims);
+	w->intents = NULL;
+	w->intent_order = NULL;
+	w->intents_capacity = 0;
+	w->claims = NULL;
+}
+
+void world_load_cell(struct world *w, size_t i, struct cell *c)
+{
+	uint32_t h = TILE_HANDLE(w, i);
+
+	c->id        = CELL_ID(w, h);
+	c->energy    = CELL_ENERGY(w, h);
+	c->age       = CELL_AGE(w, h);
+	c->oscil_dur = CELL_OSCIL_DUR(w, h);
+	c->oscil_ctr = CELL_OSCIL_CTR(w, h);
+	c->compass   = CELL_COMPASS(w, h);
+	c->updated   = CELL_UPDATED(w, h);
+	memcpy(c->genes, CELL_GENES(w, h), sizeof(gene_t[4]));
+}
+
+uint32_t world_store_cell(struct world *w, size_t i, const struct cell *c)
+{
+	uint32_t h = take_slot(w);
+
+	set_type(w, i, 2);
+	TILE_HANDLE(w, i)    = h;
+
+	CELL_TILE(w, h)      = i;
+	CELL_ID(w, h)        = c->id;
+	CELL_ENERGY(w, h)    = c->energy;
+	CELL_AGE(w, h)       = c->age;
+	CELL_OSCIL_DUR(w, h) = c->oscil_dur;
+	CELL_OSCIL_CTR(w, h) = c->oscil_ctr;
+	CELL_COMPASS(w, h)   = c->compass;
+	CELL_UPDATED(w, h)   = c->updated;
+	CELL_ACTIONS(w, h)   = 0;
+	CELL_GENOME(w, h)    = world_intern_genome(w, c->genes);
+
+	census(w)->cells++;
+	census(w)->cell_energy += c->energy;
+	return h;
+}
+
+void world_store_dead(struct world *w, size_t i, const struct dead_thing *d)
+{
+	if(TILE_TYPE(w, i) == 2)
+		free_cell(w, TILE_HANDLE(w, i));
+
+	set_type(w, i, 1);
+	TILE_ID(w, i)     = d->id;
+	TILE_ENERGY(w, i) = d->energy;
+	count_dead(w, i);
+}
+
+void world_move_cell(struct world *w, size_t dst, size_t src)
+{
+	uint32_t h = TILE_HANDLE(w, src);
+
+	set_type(w, dst, 2);
+	TILE_HANDLE(w, dst) = h;
+	CELL_TILE(w, h) = dst;
+	set_type(w, src, 0);
+}
+
+void world_kill_cell(struct world *w, size_t i)
+{
+	uint32_t h = TILE_HANDLE(w, i);
+
+	set_type(w, i, 1);
+	TILE_ID(w, i) = CELL_ID(w, h);
+	TILE_ENERGY(w, i) = calc_death_energy(CELL_ENERGY(w, h));
+	count_dead(w, i);
+	free_cell(w, h);
+}
+
+void world_remove_cell(struct world *w, size_t i)
+{
+	set_type(w, i, 0);
+	free_cell(w, TILE_HANDLE(w, i));
+}
+
+void world_remove_dead(struct world *w, size_t i)
+{
+	set_type(w, i, 0);
+}
+
+void world_save_cell(struct world *w, uint32_t h)
+{
+	struct worker *k = journaling();
+	struct undo *u;
+
+	if(k == NULL)
+		return;
+
+	slice_wrote(w, k->slice, CELL_TILE(w, h));
+	u = journal(k, UNDO_CELL, h);
+	u->cell.tile      = CELL_TILE(w, h);
+	u->cell.genome    = CELL_GENOME(w, h);
+	u->cell.since     = CELL_SINCE(w, h);
+	u->cell.deadline  = CELL_DEADLINE(w, h);
+	u->cell.id        = CELL_ID(w, h);
+	u->cell.energy    = CELL_ENERGY(w, h);
+	u->cell.age       = CELL_AGE(w, h);
+	u->cell.oscil_dur = CELL_OSCIL_DUR(w, h);
+	u->cell.oscil_ctr = CELL_OSCIL_CTR(w, h);
+	u->cell.compass   = CELL_COMPASS(w, h);
+	u->cell.actions   = CELL_ACTIONS(w, h);
+	u->cell.updated   = CELL_UPDATED(w, h);
+}
+
+/*  Straight back to the old values, the census and the free counts are
+*   left alone: the worker's census gets thrown away along with the run,
+*   and the free counts get rebuilt at the end of the step anyway.
+*/
+static void restore_tile(struct world *w, const struct undo *u)
+{
+	size_t i = u->at;
+
+	if((TILE_TYPE(w, i) == 0) != (u->type == 0))
+		w->free_bits[i >> 6] ^= UINT64_C(1) << (i & 63);
+
+	write_type(w, i, u->type);
+	mirror_tile(w, i);
+	TILE_HANDLE(w, i) = u->tile.handle;
+	TILE_ENERGY(w, i) = u->tile.energy;
+	TILE_ID(w, i)     = u->tile.id;
+}
+
+static void restore_cell(struct world *w, const struct undo *u)
+{
+	uint32_t h = u->at;
+
+	CELL_TILE(w, h)      = u->cell.tile;
+	CELL_GENOME(w, h)    = u->cell.genome;
+	CELL_SINCE(w, h)     = u->cell.since;
+	CELL_DEADLINE(w, h)  = u->cell.deadline;
+	CELL_ID(w, h)        = u->cell.id;
+	CELL_ENERGY(w, h)    = u->cell.energy;
+	CELL_AGE(w, h)       = u->cell.age;
+	CELL_OSCIL_DUR(w, h) = u->cell.oscil_dur;
+	CELL_OSCIL_CTR(w, h) = u->cell.oscil_ctr;
+	CELL_COMPASS(w, h)   = u->cell.compass;
+	CELL_ACTIONS(w, h)   = u->cell.actions;
+	CELL_UPDATED(w, h)   = u->cell.updated;
+}
+
+void world_undo(struct world *w, struct worker *k)
+{
+	while(k->n_undo) {
+		const struct undo *u = &k->undo[--k->n_undo];
+
+		switch(u->kind) {
+			case UNDO_TILE:
+			restore_tile(w, u);
 			break;
 
-			default:
-			t.type = 2;
-			gen_random_cell(&t.cell, main_rng);
+			case UNDO_CELL:
+			restore_cell(w, u);
+			break;
+
+			/* the pool ends up just as it was, or handles drift */
+			case UNDO_BORN:
+			if(u->slot == SLOT_OWN) {
+				k->used_slots--;
+			} else if(u->slot == SLOT_FREE) {
+				pool_free(&w->pool, u->at);
+			} else {
+				w->pool.count--;
+				w->pool.top--;
+			}
+			break;
+
+			case UNDO_REF:
+			genome_release(&w->genomes, u->at);
 			break;
 		}
 	}
 
-	place_food(w, c/4);
+	/* the cells it killed never died, or got counted */
+	k->n_freed = 0;
+	k->broken = false;
+	ZERO_STRUCT(k->census);
+	ZERO_STRUCT(k->stats);
 }
 
-void free_world(struct world *w) 
+void world_commit(struct world *w, struct worker *k)
 {
-	free(w->grid);
-	w->grid = NULL;
+	for(uint32_t i = 0; i < k->n_undo; i++)
+		if(k->undo[i].kind == UNDO_DROP)
+			genome_release(&w->genomes, k->undo[i].at);
+
+	for(uint32_t f = 0; f < k->n_freed; f++)
+		world_release_cell(w, k->freed[f]);
+
+	k->n_undo = 0;
+	k->n_freed = 0;
 }
 
-bool world_has_life(struct world *w) 
+bool world_has_life(struct world *w)
 {
+	return w->census.cells != 0;
+}
+
+void world_check_census(struct world *w)
+{
+	struct census real;
+	uint64_t refs = 0;
+
 	/* just use flat indexing, we don't need that fancy shit */
-	for(int i = 0; i < w->height * w->length; i++)
-		if(w->grid[i].type == 2)
-			return true;
+	ZERO_STRUCT(real);
+	for(size_t y = 1; y <= w->height; y++) {
+		for(size_t i = y * w->stride + 1; i <= y * w->stride + w->length;
+			i++) {
+			switch(TILE_TYPE(w, i)) {
+				case 1:
+				real.dead++;
+				real.dead_energy += TILE_ENERGY(w, i);
+				break;
+
+				case 2:
+				real.cells++;
+				real.cell_energy += CELL_ENERGY(w, TILE_HANDLE(w, i));
+				break;
+			}
+		}
+	}
+
+	/* and every cell holds exactly one reference to its genome */
+	for(uint32_t g = 0; g < w->genomes.top; g++)
+		refs += GENOME(&w->genomes, g).refs;
+	die(refs != w->census.cells, "The genome refcounts are off");
+
+	if(real.cells != w->census.cells || real.dead != w->census.dead ||
+		real.cell_energy != w->census.cell_energy ||
+		real.dead_energy != w->census.dead_energy) {
+		fprintf(stderr, "census: %u cells, %zu dead, energy %" PRIu64 "/%" PRIu64 "\n"
+			"scan:   %u cells, %zu dead, energy %" PRIu64 "/%" PRIu64 "\n",
+			w->census.cells, w->census.dead,
+			w->census.cell_energy, w->census.dead_energy,
+			real.cells, real.dead, real.cell_energy, real.dead_energy);
+		die(true, "The census is off");
+	}
+}
+
+/*  Everything a parked cell could be up to happens on a known step, or on
+*   the step its own dice come up, which is what the deadline is for:
+*   - starving on the step its energy runs out, with nothing to spend it
+*     on it only pays 1 a step
+*   - old age on the step it turns 2048
+*   - giving birth, which step_cell rolls for every step it has the energy
+*   - the random death, which metabolise rolls for every step past 1116
+*   The dice are keyed by the step, so they can all be rolled here, and
+*   the cell wakes up on the step the first one hits to roll it again, for
+*   real. Parked or not, it comes out the same.
+*/
+void world_park_cell(struct world *w, uint32_t h)
+{
+	/* this step's metabolism hasn't happened yet, the cell wakes owing it */
+	uint32_t now = w->iters - 1;
+	uint32_t e = CELL_ENERGY(w, h), a = CELL_AGE(w, h);
+	uint32_t due = e < 2048 - a ? e : 2048 - a;
+
+	/*  k steps on, step_cell sees k - 1 less energy, this step's birth
+	*   roll has been made already, and metabolise makes it k older
+	*/
+	for(uint32_t k = 1; k < due; k++) {
+		if((k >= 2 && e - (k - 1) >= 8 && birth_roll(w, h, now + k)) ||
+			(a + k >= 1116 && death_roll(w, h, now + k))) {
+			due = k;
+			break;
+		}
+	}
+
+	/* due next step anyway */
+	if(due < 2)
+		return;
+
+	CELL_SINCE(w, h) = now;
+	CELL_DEADLINE(w, h) = now + due;
+	CELL_ACTIONS(w, h) = CELL_DORMANT;
+}
+
+/*  k steps of metabolism with no actions, in one go: 1 energy a step, and
+*   the oscillator counter going around its 2*dur
+*/
+static void catch_up(struct world *w, uint32_t h, uint32_t now)
+{
+	uint32_t k = now - CELL_SINCE(w, h);
+	uint32_t e = CELL_ENERGY(w, h);
+	uint32_t period = 2u * CELL_OSCIL_DUR(w, h);
+
+	cell_set_energy(w, h, e > k ? e - k : 0);
+	CELL_AGE(w, h) += k;
+	CELL_OSCIL_CTR(w, h) = (CELL_OSCIL_CTR(w, h) + k % period) % period;
+	CELL_SINCE(w, h) = now;
+}
+
+void world_wake_cell(struct world *w, uint32_t h)
+{
+	/*  wakes happen during a step, before its metabolism. Its updated
+	*   flag is as old as its nap, it's had no turn this step, if its tile
+	*   has been gone past already it won't get one either.
+	*/
+	catch_up(w, h, w->iters - 1);
+	CELL_ACTIONS(w, h) = 0;
+	CELL_UPDATED(w, h) = !w->parity;
+}
+
+void world_sync(struct world *w)
+{
+	for(uint32_t h = 0; h < w->pool.top; h++)
+		if(!(CELL_TILE(w, h) & POOL_FREE) &&
+			(CELL_ACTIONS(w, h) & CELL_DORMANT))
+			catch_up(w, h, w->iters);
+}
+
+/* 1 + actions^1.5, rounded down, energy is always an integer */
+static const uint32_t consumption[8] = { 1, 2, 3, 6, 9, 12, 15, 19 };
+
+/*  Pay for the actions taken, get older and tick the oscillator, for every
+*   slot in the pool. Free slots get the same treatment since nothing reads
+*   them, it's cheaper than checking, they just don't count towards what was
+*   spent, and neither do parked cells, they're caught up in one go when
+*   they wake. No calls and no branches, and the planes are passed in as
+*   restrict so the compiler vectorizes the whole thing. -O2 only does the
+*   loops it's sure are cheap, which this isn't to gcc, so it gets the full
+*   cost model, and it's kept out of line since gcc forgets the restricts
+*   once it's inlined into something that doesn't have them.
+*/
+static inline __attribute__((__always_inline__))
+uint64_t charge(uint32_t top, const uint32_t *restrict tile,
+	uint8_t *restrict actions, energy_t *restrict energy,
+	age_t *restrict age, const oscil_t *restrict dur,
+	oscil_t *restrict ctr)
+{
+	uint64_t spent = 0;
+
+	for(size_t h = 0; h < top; h++) {
+		uint32_t e = energy[h];
+		uint32_t tick = (actions[h] & CELL_DORMANT) ? 0 : 1;
+		uint32_t cost = consumption[actions[h] & ACTIONS_TAKEN] * tick;
+		uint32_t next = ctr[h] + tick;
+
+		cost = cost < e ? cost : e;
+		energy[h] = e - cost;
+		spent += (tile[h] & POOL_FREE) ? 0 : cost;
+
+		age[h] += tick;
+
+		/* only the parity of ctr/dur matters, so wrap at twice dur */
+		ctr[h] = next >= 2u * dur[h] ? next - 2u * dur[h] : next;
+
+		actions[h] &= ~ACTIONS_TAKEN;
+	}
+
+	return spent;
+}
+
+/* charge as wide as each level goes, see cpu.h */
+#define CHARGE(name, ...)                                                 \
+__attribute__((__noinline__, __optimize__("vect-cost-model=dynamic")     \
+	__VA_OPT__(,) __VA_ARGS__))                                      \
+static uint64_t name(uint32_t top, const uint32_t *restrict tile,        \
+	uint8_t *restrict actions, energy_t *restrict energy,            \
+	age_t *restrict age, const oscil_t *restrict dur,                \
+	oscil_t *restrict ctr)                                           \
+{                                                                        \
+	return charge(top, tile, actions, energy, age, dur, ctr);        \
+}
+
+CHARGE(charge_scalar)
+CHARGE(charge_avx2, CPU_TARGET_AVX2)
+CHARGE(charge_avx512, CPU_TARGET_AVX512)
 
-	return false;
+#undef CHARGE
+
+/*  The bookkeeping half of the rules, done for all the cells at once after
+*   they all acted, instead of in step_cell. Whoever starved or got too old
+*   goes on a list and dies after.
+*/
+static void metabolise(struct world *w, struct statistics *stats)
+{
+	struct cell_pool *p = &w->pool;
+	const uint32_t top = p->top;
+	uint32_t n = 0;
+	uint64_t spent;
+
+	switch(cpu_level()) {
+		case CPU_AVX512:
+		spent = charge_avx512(top, p->tile, p->actions, p->energy,
+			p->age, p->oscil_dur, p->oscil_ctr);
+		break;
+
+		case CPU_AVX2:
+		spent = charge_avx2(top, p->tile, p->actions, p->energy,
+			p->age, p->oscil_dur, p->oscil_ctr);
+		break;
+
+		default:
+		spent = charge_scalar(top, p->tile, p->actions, p->energy,
+			p->age, p->oscil_dur, p->oscil_ctr);
+		break;
+	}
+	w->census.cell_energy -= spent;
+
+	if(unlikely(w->dying_capacity < top)) {
+		w->dying_capacity = p->capacity;
+		w->dying = realloc(w->dying,
+			w->dying_capacity * sizeof(*w->dying));
+		die(w->dying == NULL, "Couldn't grow the death list");
+	}
+
+	for(uint32_t h = 0; h < top; h++) {
+		/* parked cells are woken on their deadline, they die after */
+		if((p->tile[h] & POOL_FREE) || (p->actions[h] & CELL_DORMANT))
+			continue;
+
+		if(
+			p->energy[h] == 0 || /* starvation */
+			p->age[h] >= 2048 || /* and old age */
+			(p->age[h] >= 1116 &&
+				unlikely(death_roll(w, h, w->iters)))
+		)
+			w->dying[n++] = h;
+	}
+
+	/* commit die */
+	for(uint32_t i = 0; i < n; i++) {
+		uint32_t h = w->dying[i];
+
+		stats->death++;
+		if(p->energy[h] == 0)
+			stats->starve++;
+		else
+			stats->old_age++;
+
+		world_kill_cell(w, CELL_TILE(w, h));
+	}
+}
+
+/* every other bit of d, block coordinates out of a Z-order index */
+static inline uint32_t unzip(uint32_t d)
+{
+	d &= 0x55555555;
+	d = (d | d >> 1) & 0x33333333;
+	d = (d | d >> 2) & 0x0f0f0f0f;
+	d = (d | d >> 4) & 0x00ff00ff;
+	d = (d | d >> 8) & 0x0000ffff;
+	return d;
+}
+
+/*  One square of ORDER_BLOCKED, row by row. Empty tiles get skipped off the
+*   alive bits instead of calling step_cell on them, the bits are read again
+*   after every cell so children born ahead still get their turn, just like
+*   they would if step_cell got called on every tile.
+*/
+static void step_block(struct world *w, struct statistics *stats,
+	uint32_t bx, uint32_t by)
+{
+	uint32_t x0 = bx * ORDER_BLOCK, y0 = by * ORDER_BLOCK;
+	uint32_t wide = w->length - x0 < ORDER_BLOCK ?
+		w->length - x0 : ORDER_BLOCK;
+	uint32_t tall = w->height - y0 < ORDER_BLOCK ?
+		w->height - y0 : ORDER_BLOCK;
+
+	for(uint32_t y = y0; y < y0 + tall; y++) {
+		size_t row = INDEX_WORLD(*w, x0, y);
+
+		for(uint32_t x = 0; x < wide; x++) {
+			uint64_t bits = bits_at(w->alive_bits, row + x);
+
+			if(wide - x < 64)
+				bits &= (UINT64_C(1) << (wide - x)) - 1;
+			if(bits == 0) {
+				x += 63;
+				continue;
+			}
+
+			x += __builtin_ctzll(bits);
+			step_cell(w, stats, x0 + x, y);
+		}
+	}
+}
+
+/* ORDER_BLOCKED, the squares that are off the world are skipped */
+static void step_blocks(struct world *w, struct statistics *stats)
+{
+	uint32_t across = (w->length + ORDER_BLOCK - 1) / ORDER_BLOCK;
+	uint32_t down = (w->height + ORDER_BLOCK - 1) / ORDER_BLOCK;
+	uint32_t side = 1;
+
+	while(side < across || side < down)
+		side *= 2;
+
+	for(uint32_t d = 0; d < side * side; d++) {
+		uint32_t bx = unzip(d), by = unzip(d >> 1);
+
+		if(bx < across && by < down)
+			step_block(w, stats, bx, by);
+	}
+}
+
+/*  A keyed one to one mapping of [0, 2^bits) onto itself, for shuffling
+*   without anything to shuffle. Multiplying by an odd number, xoring the
+*   top half into the bottom and adding are each one to one mod 2^bits, so
+*   a few rounds of them are too, and mix well enough that no tile is any
+*   likelier to go before its neighbours than after.
+*/
+static inline uint32_t shuffle_index(uint32_t i, uint64_t key,
+	unsigned int bits)
+{
+	uint32_t mask = (UINT64_C(1) << bits) - 1;
+	uint32_t mul = (uint32_t)key | 1, add = key >> 32;
+
+	for(int r = 0; r < 3; r++) {
+		i = (i * mul) & mask;
+		i ^= i >> (bits / 2 + 1);
+		i = (i + add) & mask;
+	}
+
+	return i;
+}
+
+/*  One square of ORDER_SHUFFLED, the parts off the world are skipped. The
+*   tiles go in the step's order xored with the square's own mask, which is
+*   one to one too, so no two squares go the same way.
+*/
+static void step_square(struct world *w, struct statistics *stats,
+	uint32_t bx, uint32_t by, const uint16_t *order, uint16_t mask)
+{
+	uint32_t x0 = bx * ORDER_BLOCK, y0 = by * ORDER_BLOCK;
+
+	for(uint32_t d = 0; d < ORDER_BLOCK * ORDER_BLOCK; d++) {
+		uint32_t t = order[d] ^ mask;
+		uint32_t x = x0 + t % ORDER_BLOCK, y = y0 + t / ORDER_BLOCK;
+
+		if(x < w->length && y < w->height &&
+			TILE_TYPE(w, INDEX_WORLD(*w, x, y)) == 2)
+			step_cell(w, stats, x, y);
+	}
+}
+
+/*  ORDER_SHUFFLED, the squares through a shuffle of the next power of two
+*   up from how many there are, the ones past the end are skipped. The
+*   order of the tiles in a square is worked out once a step, it's only
+*   as big as a square, shuffling every tile on its own costs more than
+*   stepping most of them does.
+*/
+static void step_shuffled(struct world *w, struct statistics *stats)
+{
+	const unsigned int tile_bits = 2 * __builtin_ctz(ORDER_BLOCK);
+	uint32_t across = (w->length + ORDER_BLOCK - 1) / ORDER_BLOCK;
+	uint32_t down = (w->height + ORDER_BLOCK - 1) / ORDER_BLOCK;
+	uint32_t squares = across * down;
+	uint64_t key = gen64(main_rng), tiles = gen64(main_rng);
+	uint16_t order[ORDER_BLOCK * ORDER_BLOCK];
+	unsigned int bits = 0;
+
+	while((UINT32_C(1) << bits) < squares)
+		bits++;
+
+	for(uint32_t d = 0; d < ORDER_BLOCK * ORDER_BLOCK; d++)
+		order[d] = shuffle_index(d, tiles, tile_bits);
+
+	for(uint32_t d = 0; d < UINT32_C(1) << bits; d++) {
+		uint32_t b = shuffle_index(d, key, bits);
+
+		if(b < squares)
+			step_square(w, stats, b % across, b / across, order,
+				(b * 0x9e3779b9u >> 16 ^ tiles >> 48) &
+				(ORDER_BLOCK * ORDER_BLOCK - 1));
+	}
 }
 
 void step_world(struct world *w, struct statistics *stats)
@@ -93,10 +1422,102 @@ void step_world(struct world *w, struct statistics *stats)
 	if((w->iters += 1) % w->food_gen_iters == 0)
 		place_food(w, isqrt((w->length * w->height))/32);
 
-	/* next, iterate through each cell */
-	for(uint32_t y = 0; y < w->length; y++) {
-		for(uint32_t x = 0; x < w->length; x++) {
-			step_cell(&INDEX_WORLD((*w), x, y), w, stats, x, y);
+	w->parity = !w->parity;
+
+	/*  next, iterate through each cell, worlds too small to cut into
+	*   stripes get stepped the usual way
+	*/
+	if(w->step_mode == STEP_INTENT) {
+		commit_intents(w, stats, intend_cells(w));
+	} else if(w->step_mode == STEP_STRIPES && step_stripes(w, stats)) {
+		/* done by the threads */
+	} else if(w->step_mode == STEP_SPECULATE && step_speculate(w, stats)) {
+		/* the same, but in order as far as anyone can tell */
+	} else if(w->step_mode != STEP_DENSE &&
+		w->step_mode != STEP_SPECULATE) {
+		/*  Straight through the pool, in whatever order the slots were
+		*   handed out. Dead slots are skipped, and anything that already
+		*   got updated (or moved) gets caught by step_cell.
+		*/
+		for(uint32_t h = 0; h < w->pool.top; h++) {
+			uint32_t t = CELL_TILE(w, h), y;
+
+			if((t & POOL_FREE) || cell_asleep(w, h))
+				continue;
+
+			y = world_row(w, t);
+			step_cell(w, stats, t - y * w->stride - 1, y - 1);
+		}
+	} else if(w->order == ORDER_BLOCKED) {
+		step_blocks(w, stats);
+	} else if(w->order == ORDER_SHUFFLED) {
+		step_shuffled(w, stats);
+	} else {
+		for(uint32_t y = 0; y < w->height; y++) {
+			for(uint32_t x = 0; x < w->length; x++) {
+				step_cell(w, stats, x, y);
+			}
 		}
 	}
-}
\ No newline at end of file
+
+	metabolise(w, stats);
+
+	stats->pop     = w->census.cells;
+	stats->food    = w->census.dead;
+	stats->species = w->genomes.count;
+
+#ifdef CELLS_DEBUG
+	world_check_census(w);
+#endif
+}
+
+/* one field of a step into the running totals */
+#define FOLD(f) do {                                         \
+	total.f  += step.f;                                  \
+	highest.f = step.f > highest.f ? step.f : highest.f; \
+	lowest.f  = step.f < lowest.f  ? step.f : lowest.f;  \
+} while(0)
+
+unsigned int step_world_n(struct world *w, unsigned int n,
+	struct run_totals *t, int flags)
+{
+	/*  Kept in locals for the whole run rather than going through t, the
+	*   steps write through plenty of pointers the compiler can't rule out
+	*/
+	struct statistics highest = t->highest;
+	struct statistics lowest  = t->lowest;
+	struct statistics total   = t->total;
+	unsigned int i = 0;
+
+	if(t->steps == 0)
+		memset(&lowest, 0xff, sizeof(lowest));
+
+	while(i < n) {
+		struct statistics step = { 0 };
+
+		step_world(w, &step);
+		i++;
+
+		FOLD(pop);
+		FOLD(death);
+		FOLD(food);
+		FOLD(old_age);
+		FOLD(murder);
+		FOLD(starve);
+		FOLD(suicide);
+		FOLD(births);
+		FOLD(species);
+
+		/* the census is kept up to date, no need to look at the tiles */
+		if((flags & RUN_STOP_EXTINCT) && w->census.cells == 0)
+			break;
+	}
+
+	t->steps  += i;
+	t->highest = highest;
+	t->lowest  = lowest;
+	t->total   = total;
+	return i;
+}
+
+#undef FOLD